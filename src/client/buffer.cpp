@@ -5,7 +5,9 @@
 */
 #include "buffer.h"
 #include "buffer_p.h"
+#include "pixelconversion_p.h"
 #include "shm_pool.h"
+#include "shm_pool_p.h"
 // system
 #include <string.h>
 // wayland
@@ -48,6 +50,12 @@ void Buffer::Private::releasedCallback(void *data, wl_buffer *buffer)
     auto b = reinterpret_cast<Buffer::Private *>(data);
     Q_ASSERT(b->nativeBuffer == buffer);
     b->q->setReleased(true);
+    QWeakPointer<Buffer> released;
+    {
+        QMutexLocker locker(&b->shm->d->mutex);
+        released = b->shm->d->buffers.value(b->q).toWeakRef();
+    }
+    Q_EMIT b->shm->bufferReleased(released);
 }
 
 Buffer::Buffer(ShmPool *parent, wl_buffer *buffer, const QSize &size, int32_t stride, size_t offset, Format format)
@@ -59,7 +67,40 @@ Buffer::~Buffer() = default;
 
 void Buffer::copy(const void *src)
 {
-    memcpy(address(), src, d->size.height() * d->stride);
+    // keeps the pool from being unmapped while copying
+    QReadLocker locker(&d->shm->d->mappingLock);
+    memcpy(reinterpret_cast<uchar *>(d->shm->d->poolData) + d->offset, src, d->size.height() * d->stride);
+}
+
+void Buffer::copy(const void *src, const QRegion &damage)
+{
+    copy(src, d->stride, damage);
+}
+
+void Buffer::copy(const void *src, int32_t sourceStride, const QRegion &damage)
+{
+    const QRect bufferRect(QPoint(0, 0), d->size);
+    const int pixelSize = bytesPerPixel(d->format);
+    QReadLocker locker(&d->shm->d->mappingLock);
+    uchar *dst = reinterpret_cast<uchar *>(d->shm->d->poolData) + d->offset;
+    const uchar *source = reinterpret_cast<const uchar *>(src);
+    for (const QRect &rect : damage) {
+        const QRect r = rect & bufferRect;
+        if (r.isEmpty()) {
+            continue;
+        }
+        const size_t dstOffset = r.y() * d->stride + r.x() * pixelSize;
+        const size_t srcOffset = r.y() * sourceStride + r.x() * pixelSize;
+        if (r.width() == d->size.width() && sourceStride == d->stride) {
+            // full scanlines are contiguous
+            memcpy(dst + dstOffset, source + srcOffset, r.height() * d->stride);
+            continue;
+        }
+        const size_t length = r.width() * pixelSize;
+        for (int y = 0; y < r.height(); ++y) {
+            memcpy(dst + dstOffset + y * d->stride, source + srcOffset + y * sourceStride, length);
+        }
+    }
 }
 
 uchar *Buffer::address()
@@ -84,12 +125,18 @@ Buffer::operator wl_buffer *() const
 
 bool Buffer::isReleased() const
 {
+    QMutexLocker locker(&d->shm->d->mutex);
     return d->released;
 }
 
 void Buffer::setReleased(bool released)
 {
+    QMutexLocker locker(&d->shm->d->mutex);
+    if (d->released == released) {
+        return;
+    }
     d->released = released;
+    d->shm->d->bufferStateChanged(this);
 }
 
 QSize Buffer::size() const
@@ -104,12 +151,18 @@ int32_t Buffer::stride() const
 
 bool Buffer::isUsed() const
 {
+    QMutexLocker locker(&d->shm->d->mutex);
     return d->used;
 }
 
 void Buffer::setUsed(bool used)
 {
+    QMutexLocker locker(&d->shm->d->mutex);
+    if (d->used == used) {
+        return;
+    }
     d->used = used;
+    d->shm->d->bufferStateChanged(this);
 }
 
 Buffer::Format Buffer::format() const
@@ -6,6 +6,7 @@
 #ifndef WAYLAND_BUFFER_H
 #define WAYLAND_BUFFER_H
 
+#include <QRegion>
 #include <QScopedPointer>
 #include <QSize>
 #include <QWeakPointer>
@@ -36,13 +37,33 @@ public:
     enum class Format {
         ARGB32, ///< 32-bit ARGB format, can be used for QImage::Format_ARGB32 and QImage::Format_ARGB32_Premultiplied
         RGB32, ///< 32-bit RGB format, can be used for QImage::Format_RGB32
+        RGB565, ///< 16-bit RGB format, can be used for QImage::Format_RGB16 @since 6.2
+        ABGR32, ///< 32-bit ABGR format, can be used for QImage::Format_RGBA8888_Premultiplied @since 6.2
+        XBGR32, ///< 32-bit BGR format, can be used for QImage::Format_RGBX8888 @since 6.2
+        ARGB2101010, ///< 32-bit ARGB format with 10 bits per color, can be used for QImage::Format_A2RGB30_Premultiplied @since 6.2
     };
 
     ~Buffer();
     /**
      * Copies the data from @p src into the Buffer.
+     *
+     * Copying may happen on any thread, also while the ShmPool provides Buffers
+     * on another thread.
      **/
     void copy(const void *src);
+    /**
+     * Copies only the scanline spans within @p damage from @p src into the Buffer.
+     * The memory at @p src must have the same size, stride and format as the Buffer.
+     * @since 6.2
+     **/
+    void copy(const void *src, const QRegion &damage);
+    /**
+     * Copies only the scanline spans within @p damage from @p src into the Buffer.
+     * The memory at @p src must have the same size and format as the Buffer, but its
+     * scanlines are @p sourceStride bytes apart, e.g. QImage::bytesPerLine.
+     * @since 6.2
+     **/
+    void copy(const void *src, int32_t sourceStride, const QRegion &damage);
     /**
      * Sets the Buffer as @p released.
      * This is automatically invoked when the Wayland server sends the release event.
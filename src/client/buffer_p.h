@@ -29,6 +29,9 @@ public:
     size_t offset;
     bool used;
     Format format;
+    // damage history and frame of the ShmPool whose content the Buffer holds, sequence is 0 if unknown
+    quint64 history = 0;
+    quint64 sequence = 0;
 
 private:
     Buffer *q;
@@ -4,46 +4,172 @@
     SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
 */
 #include "connection_thread.h"
+#include "connectionreactor_p.h"
+#include "dispatchstatistics_p.h"
+#include "event_queue.h"
 #include "logging.h"
+#include "protocolrecorder_p.h"
+#include "roundtrip_p.h"
 // Qt
 #include <QAbstractEventDispatcher>
 #include <QDebug>
 #include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
 #include <QFileSystemWatcher>
 #include <QGuiApplication>
 #include <QMutex>
 #include <QMutexLocker>
+#include <QPointer>
 #include <QSocketNotifier>
+#include <QThread>
 #include <qpa/qplatformnativeinterface.h>
 // Wayland
 #include <wayland-client-protocol.h>
+#include <wayland-version.h>
 
+#include <atomic>
+#include <memory>
+#include <utility>
+
+#include <errno.h>
 #include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
 
 namespace KWayland
 {
 namespace Client
 {
-class Q_DECL_HIDDEN ConnectionThread::Private
+class Q_DECL_HIDDEN ConnectionThread::Private : public ConnectionReactor::Connection
 {
 public:
     Private(ConnectionThread *q);
-    ~Private();
+    ~Private() override;
     void doInitConnection();
+    /**
+     * Connects to the Wayland server through the ProtocolRecorder.
+     * @returns The file descriptor to pass to wl_display_connect_to_fd, @c -1 on failure.
+     **/
+    int connectRecorder();
     void setupSocketNotifier();
+    void setupWriteNotifier();
+    /**
+     * Watches for the socket to become writable again, may be invoked from any thread.
+     * The writeNotifier is only accessed from the thread of the ConnectionThread.
+     **/
+    void setFlushPending();
     void setupSocketFileWatcher();
     void dispatchEvents();
+    /**
+     * Dispatches the default queue and wakes up the EventQueues once events got read.
+     **/
+    void dispatchReadEvents();
+    enum class DispatchResult {
+        Error,
+        Done,
+        BudgetReached,
+    };
+    /**
+     * Dispatches the default queue until it is empty or the dispatch budget is used up.
+     * The budget only counts as exceeded if the next pass still finds events pending.
+     **/
+    DispatchResult dispatchDefaultQueue();
+    DispatchResult dispatchDefaultQueue(int &count);
+    /**
+     * Records when events got read, as long as anyone measures the read to dispatch latency.
+     **/
+    void markEventsRead();
+    void handleDispatchError();
+    void startDispatchThread();
+    /**
+     * Stops reading events outside of the thread of the ConnectionThread, through the
+     * dispatchThread or the ConnectionReactor.
+     **/
+    void stopDispatchThread();
+    /**
+     * Hands reading the events over to the ConnectionReactor.
+     **/
+    void startSharedReading();
+    /**
+     * The Wayland socket got removed, so the server is gone.
+     **/
+    void serverSocketRemoved();
+    /**
+     * The Wayland socket got created, reconnects if the server was gone.
+     **/
+    void serverSocketCreated();
+    // ConnectionReactor::Connection
+    void prepareRead() override;
+    bool readEvents(bool readable) override;
+    void socketRemoved() override;
+    void socketCreated() override;
+    /**
+     * Reads the Wayland socket until stopDispatchThread is called, runs in the dispatchThread.
+     **/
+    void readEvents();
+    /**
+     * Dispatches the default queue in the thread of the ConnectionThread once, no matter how
+     * often it gets invoked until then.
+     **/
+    void scheduleDispatch();
+    /**
+     * Continues dispatching once the dispatch budget got used up. The socketNotifier stays
+     * disabled until the default queue is drained, so that reading more events does not
+     * start another budget in the same event loop iteration.
+     **/
+    void scheduleBudgetedDispatch();
 
     wl_display *display = nullptr;
     int fd = -1;
     QString socketName;
     QDir runtimeDir;
     QScopedPointer<QSocketNotifier> socketNotifier;
+    // enabled while the socket is full and requests are waiting to be flushed
+    QScopedPointer<QSocketNotifier> writeNotifier;
+    std::atomic<bool> flushPending{false};
     QScopedPointer<QFileSystemWatcher> socketWatcher;
     bool serverDied = false;
     bool foreign = false;
     QMetaObject::Connection eventDispatcherConnection;
     int error = 0;
+    ConnectionThread::DispatchMode dispatchMode = ConnectionThread::DispatchMode::SocketNotifier;
+    QThread *dispatchThread = nullptr;
+    // eventfd to wake up the dispatchThread for quitting
+    int wakeupFd = -1;
+    std::atomic<bool> quitDispatchThread{false};
+    std::atomic<bool> dispatchPending{false};
+    // dispatching the events read by an EventQueue is scheduled
+    std::atomic<bool> readDispatchPending{false};
+    // private queue for reading through the ConnectionReactor, never gets any events
+    wl_event_queue *readQueue = nullptr;
+    // whether the socket is watched by the ConnectionReactor rather than the socketWatcher
+    bool socketWatchedByReactor = false;
+    // EventQueues set up for this connection, woken up whenever events got read
+    QMutex eventQueuesMutex;
+    QList<EventQueue *> eventQueues;
+    PendingRoundtrips roundtrips;
+    // dispatch budget, 0 for unlimited
+    int maxEventsPerDispatch = 0;
+    int maxDispatchTime = 0;
+    quint64 dispatchBudgetExceededCount = 0;
+    // the previous pass used up the dispatch budget
+    bool dispatchBudgetReached = false;
+    DispatchInstrumentation instrumentation;
+    // the ConnectionThread and EventQueues with enabled instrumentation
+    std::atomic<int> readTimestampUsers{0};
+    std::atomic<qint64> lastReadTime{0};
+    // read time of the events last dispatched on the default queue
+    qint64 lastDispatchedReadTime = 0;
+    QString traceFile;
+    qint64 traceCapacity = 0;
+    // connections recorded so far, reconnects get recorded into suffixed files
+    int recordedConnections = 0;
+    // forwards the traffic while recording, only destroyed once the connection got closed
+    std::unique_ptr<ProtocolRecorder> recorder;
     static QList<ConnectionThread *> connections;
     static QRecursiveMutex mutex;
 
@@ -74,6 +200,9 @@ ConnectionThread::Private::~Private()
         QMutexLocker lock(&mutex);
         connections.removeOne(q);
     }
+    if (display) {
+        roundtrips.cancel();
+    }
     if (display && !foreign) {
         wl_display_flush(display);
         wl_display_disconnect(display);
@@ -82,7 +211,12 @@ ConnectionThread::Private::~Private()
 
 void ConnectionThread::Private::doInitConnection()
 {
-    if (fd != -1) {
+    if (!traceFile.isEmpty()) {
+        const int recorderFd = connectRecorder();
+        if (recorderFd != -1) {
+            display = wl_display_connect_to_fd(recorderFd);
+        }
+    } else if (fd != -1) {
         display = wl_display_connect_to_fd(fd);
     } else {
         display = wl_display_connect(socketName.toUtf8().constData());
@@ -98,12 +232,58 @@ void ConnectionThread::Private::doInitConnection()
         qCDebug(KWAYLAND_CLIENT) << "Connected to Wayland server at:" << socketName;
     }
 
-    // setup socket notifier
-    setupSocketNotifier();
+    switch (dispatchMode) {
+    case ConnectionThread::DispatchMode::DedicatedThread:
+        startDispatchThread();
+        break;
+    case ConnectionThread::DispatchMode::SharedThread:
+        startSharedReading();
+        break;
+    case ConnectionThread::DispatchMode::SocketNotifier:
+        setupSocketNotifier();
+        break;
+    }
+    setupWriteNotifier();
     setupSocketFileWatcher();
     Q_EMIT q->connected();
 }
 
+int ConnectionThread::Private::connectRecorder()
+{
+    int serverFd = fd;
+    if (serverFd == -1) {
+        // same lookup as wl_display_connect
+        const QString path = QDir::isAbsolutePath(socketName) ? socketName : runtimeDir.absoluteFilePath(socketName);
+        const QByteArray encodedPath = QFile::encodeName(path);
+        struct sockaddr_un address = {};
+        if (size_t(encodedPath.size()) >= sizeof(address.sun_path)) {
+            qCWarning(KWAYLAND_CLIENT) << "Wayland socket path is too long:" << path;
+            return -1;
+        }
+        address.sun_family = AF_UNIX;
+        memcpy(address.sun_path, encodedPath.constData(), encodedPath.size());
+        serverFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (serverFd == -1) {
+            return -1;
+        }
+        if (::connect(serverFd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == -1) {
+            close(serverFd);
+            return -1;
+        }
+    }
+    // keeps the recording of a previous connection, object ids start over with each connection
+    const QString fileName = recordedConnections == 0 ? traceFile : traceFile + QLatin1Char('.') + QString::number(recordedConnections);
+    recorder.reset(new ProtocolRecorder);
+    const int recorderFd = recorder->start(serverFd, fileName, traceCapacity);
+    if (recorderFd == -1) {
+        recorder.reset();
+    } else {
+        ++recordedConnections;
+        qCDebug(KWAYLAND_CLIENT) << "Recording Wayland protocol traffic into:" << fileName;
+    }
+    return recorderFd;
+}
+
 void ConnectionThread::Private::setupSocketNotifier()
 {
     const int fd = wl_display_get_fd(display);
@@ -113,6 +293,45 @@ void ConnectionThread::Private::setupSocketNotifier()
     });
 }
 
+void ConnectionThread::Private::setupWriteNotifier()
+{
+    writeNotifier.reset(new QSocketNotifier(wl_display_get_fd(display), QSocketNotifier::Write));
+    writeNotifier->setEnabled(false);
+    QObject::connect(writeNotifier.data(), &QSocketNotifier::activated, q, [this]() {
+        if (!display) {
+            return;
+        }
+        if (wl_display_flush(display) == -1 && errno == EAGAIN) {
+            // still full, keep waiting
+            return;
+        }
+        writeNotifier->setEnabled(false);
+        flushPending = false;
+        Q_EMIT q->flushPendingChanged(false);
+    });
+}
+
+void ConnectionThread::Private::setFlushPending()
+{
+    if (flushPending.exchange(true)) {
+        return;
+    }
+    auto watch = [this] {
+        if (!writeNotifier) {
+            // the connection went away in the meantime
+            flushPending = false;
+            return;
+        }
+        writeNotifier->setEnabled(true);
+        Q_EMIT q->flushPendingChanged(true);
+    };
+    if (q->thread() == QThread::currentThread()) {
+        watch();
+    } else {
+        QMetaObject::invokeMethod(q, watch, Qt::QueuedConnection);
+    }
+}
+
 void ConnectionThread::Private::dispatchEvents()
 {
     if (!display) {
@@ -120,9 +339,23 @@ void ConnectionThread::Private::dispatchEvents()
     }
     // first dispatch any pending events on the default queue
     while (wl_display_prepare_read(display) != 0) {
-        wl_display_dispatch_pending(display);
+        const DispatchResult result = dispatchDefaultQueue();
+        if (result == DispatchResult::Done) {
+            continue;
+        }
+        if (result == DispatchResult::Error) {
+            handleDispatchError();
+            if (!display) {
+                return;
+            }
+        } else {
+            // reading requires an empty default queue, give the event loop a chance first
+            scheduleBudgetedDispatch();
+        }
+        q->flush();
+        return;
     }
-    wl_display_flush(display);
+    q->flush();
     // then check if there are any new events waiting to be read
     struct pollfd pfd;
     pfd.fd = wl_display_get_fd(display);
@@ -130,62 +363,354 @@ void ConnectionThread::Private::dispatchEvents()
     int ret = poll(&pfd, 1, 0);
     if (ret > 0) {
         // if yes, read them now
-        wl_display_read_events(display);
+        if (wl_display_read_events(display) == 0) {
+            markEventsRead();
+        }
     } else {
         wl_display_cancel_read(display);
     }
+    dispatchReadEvents();
+}
 
+void ConnectionThread::Private::dispatchReadEvents()
+{
     // finally, dispatch the default queue and all frame queues
-    if (wl_display_dispatch_pending(display) == -1) {
-        error = wl_display_get_error(display);
-        if (error != 0) {
-            if (display) {
-                free(display);
-                display = nullptr;
-            }
-            Q_EMIT q->errorOccurred();
+    switch (dispatchDefaultQueue()) {
+    case DispatchResult::Error:
+        handleDispatchError();
+        if (!display) {
             return;
         }
+        break;
+    case DispatchResult::BudgetReached:
+        scheduleBudgetedDispatch();
+        break;
+    case DispatchResult::Done:
+        break;
     }
     Q_EMIT q->eventsRead();
+    q->wakeUpEventQueues();
+}
+
+ConnectionThread::Private::DispatchResult ConnectionThread::Private::dispatchDefaultQueue()
+{
+    DispatchInstrumentation::Histograms *histograms = instrumentation.active();
+    if (!histograms) {
+        int count = 0;
+        return dispatchDefaultQueue(count);
+    }
+    const qint64 start = DispatchInstrumentation::now();
+    const qint64 readTime = lastReadTime.load(std::memory_order_relaxed);
+    if (readTime > lastDispatchedReadTime) {
+        histograms->readToDispatchLatency.record(start - readTime);
+        lastDispatchedReadTime = readTime;
+    }
+    int count = 0;
+    const DispatchResult result = dispatchDefaultQueue(count);
+    if (count > 0) {
+        histograms->eventsPerWakeup.record(count);
+        histograms->dispatchDuration.record(DispatchInstrumentation::now() - start);
+    }
+    return result;
+}
+
+ConnectionThread::Private::DispatchResult ConnectionThread::Private::dispatchDefaultQueue(int &count)
+{
+#if WAYLAND_VERSION_MAJOR > 1 || (WAYLAND_VERSION_MAJOR == 1 && WAYLAND_VERSION_MINOR >= 23)
+    if (maxEventsPerDispatch > 0 || maxDispatchTime > 0) {
+        QElapsedTimer timer;
+        timer.start();
+        while (true) {
+            const int ret = wl_display_dispatch_pending_single(display);
+            if (ret == -1) {
+                dispatchBudgetReached = false;
+                return DispatchResult::Error;
+            }
+            if (std::exchange(dispatchBudgetReached, false) && ret == 1) {
+                // the previous pass yielded with events left
+                ++dispatchBudgetExceededCount;
+                Q_EMIT q->dispatchBudgetExceeded();
+            }
+            if (ret == 0) {
+                return DispatchResult::Done;
+            }
+            ++count;
+            if ((maxEventsPerDispatch > 0 && count >= maxEventsPerDispatch) || (maxDispatchTime > 0 && timer.hasExpired(maxDispatchTime))) {
+                dispatchBudgetReached = true;
+                return DispatchResult::BudgetReached;
+            }
+        }
+    }
+#endif
+    // without a budget or dispatching single events, everything gets dispatched at once
+    dispatchBudgetReached = false;
+    count = wl_display_dispatch_pending(display);
+    return count == -1 ? DispatchResult::Error : DispatchResult::Done;
+}
+
+void ConnectionThread::Private::markEventsRead()
+{
+    if (readTimestampUsers.load(std::memory_order_relaxed) > 0) {
+        lastReadTime.store(DispatchInstrumentation::now(), std::memory_order_relaxed);
+    }
+}
+
+void ConnectionThread::Private::handleDispatchError()
+{
+    error = wl_display_get_error(display);
+    if (error == 0) {
+        return;
+    }
+    stopDispatchThread();
+    // the connection is gone, so the callbacks cannot be destroyed anymore
+    roundtrips.cancel(false);
+    free(display);
+    display = nullptr;
+    Q_EMIT q->errorOccurred();
+}
+
+void ConnectionThread::Private::startDispatchThread()
+{
+    wakeupFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (wakeupFd == -1) {
+        qCWarning(KWAYLAND_CLIENT) << "Could not create eventfd, reading events in the thread of the connection";
+        setupSocketNotifier();
+        return;
+    }
+    quitDispatchThread = false;
+    dispatchThread = QThread::create([this] {
+        readEvents();
+    });
+    dispatchThread->setObjectName(QStringLiteral("KWaylandDispatch"));
+    dispatchThread->start();
+}
+
+void ConnectionThread::Private::stopDispatchThread()
+{
+    if (readQueue) {
+        if (ConnectionReactor *reactor = ConnectionReactor::self()) {
+            reactor->removeConnection(this);
+        }
+        wl_event_queue_destroy(readQueue);
+        readQueue = nullptr;
+    }
+    if (!dispatchThread) {
+        return;
+    }
+    quitDispatchThread = true;
+    const uint64_t value = 1;
+    if (write(wakeupFd, &value, sizeof(value)) < 0) {
+        qCWarning(KWAYLAND_CLIENT) << "Could not wake up the dispatch thread";
+    }
+    dispatchThread->wait();
+    delete dispatchThread;
+    dispatchThread = nullptr;
+    close(wakeupFd);
+    wakeupFd = -1;
+}
+
+void ConnectionThread::Private::readEvents()
+{
+    // reading requires preparing a queue, this one never gets events so preparing always succeeds
+    // and the default queue is left to the thread of the ConnectionThread
+    wl_event_queue *readQueue = wl_display_create_queue(display);
+    struct pollfd pfds[2];
+    pfds[0].fd = wl_display_get_fd(display);
+    pfds[0].events = POLLIN;
+    pfds[1].fd = wakeupFd;
+    pfds[1].events = POLLIN;
+    while (!quitDispatchThread) {
+        if (wl_display_prepare_read_queue(display, readQueue) != 0) {
+            wl_display_dispatch_queue_pending(display, readQueue);
+            continue;
+        }
+        const int ret = poll(pfds, 2, -1);
+        if (ret <= 0 || (pfds[1].revents & POLLIN)) {
+            // interrupted or asked to quit, which gets checked at the start of the loop
+            wl_display_cancel_read(display);
+            if (ret == -1 && errno != EINTR) {
+                break;
+            }
+            continue;
+        }
+        if (wl_display_read_events(display) == -1) {
+            // the error is reported when dispatching the default queue
+            scheduleDispatch();
+            break;
+        }
+        markEventsRead();
+        scheduleDispatch();
+        // the event queues in other threads can dispatch right away, without waiting for this one
+        Q_EMIT q->eventsRead();
+        q->wakeUpEventQueues();
+    }
+    wl_event_queue_destroy(readQueue);
+}
+
+void ConnectionThread::Private::startSharedReading()
+{
+    ConnectionReactor *reactor = ConnectionReactor::self();
+    readQueue = wl_display_create_queue(display);
+    if (!reactor || !readQueue || !reactor->addConnection(this, wl_display_get_fd(display))) {
+        qCWarning(KWAYLAND_CLIENT) << "Could not use the shared dispatch thread, reading events in the thread of the connection";
+        if (readQueue) {
+            wl_event_queue_destroy(readQueue);
+            readQueue = nullptr;
+        }
+        setupSocketNotifier();
+    }
+}
+
+void ConnectionThread::Private::prepareRead()
+{
+    // the readQueue never gets events, so this only fails while another thread reads
+    while (wl_display_prepare_read_queue(display, readQueue) != 0) {
+        wl_display_dispatch_queue_pending(display, readQueue);
+    }
+}
+
+bool ConnectionThread::Private::readEvents(bool readable)
+{
+    if (!readable) {
+        wl_display_cancel_read(display);
+        return true;
+    }
+    if (wl_display_read_events(display) == -1) {
+        // the error is reported when dispatching the default queue
+        scheduleDispatch();
+        return false;
+    }
+    markEventsRead();
+    scheduleDispatch();
+    Q_EMIT q->eventsRead();
+    q->wakeUpEventQueues();
+    return true;
+}
+
+void ConnectionThread::Private::socketRemoved()
+{
+    QMetaObject::invokeMethod(
+        q,
+        [this] {
+            serverSocketRemoved();
+        },
+        Qt::QueuedConnection);
+}
+
+void ConnectionThread::Private::socketCreated()
+{
+    QMetaObject::invokeMethod(
+        q,
+        [this] {
+            serverSocketCreated();
+        },
+        Qt::QueuedConnection);
+}
+
+void ConnectionThread::Private::scheduleDispatch()
+{
+    if (dispatchPending.exchange(true)) {
+        return;
+    }
+    QMetaObject::invokeMethod(
+        q,
+        [this] {
+            dispatchPending = false;
+            if (!display) {
+                return;
+            }
+            const DispatchResult result = dispatchDefaultQueue();
+            if (result != DispatchResult::BudgetReached && socketNotifier) {
+                // drained, read new events again
+                socketNotifier->setEnabled(true);
+            }
+            switch (result) {
+            case DispatchResult::Error:
+                handleDispatchError();
+                return;
+            case DispatchResult::BudgetReached:
+                // continue in the next event loop iteration
+                scheduleBudgetedDispatch();
+                break;
+            case DispatchResult::Done:
+                break;
+            }
+            q->flush();
+        },
+        Qt::QueuedConnection);
+}
+
+void ConnectionThread::Private::scheduleBudgetedDispatch()
+{
+    if (socketNotifier) {
+        socketNotifier->setEnabled(false);
+    }
+    scheduleDispatch();
 }
 
 void ConnectionThread::Private::setupSocketFileWatcher()
 {
-    if (!runtimeDir.exists() || fd != -1) {
+    if (!runtimeDir.exists() || fd != -1 || socketWatchedByReactor) {
+        // the ConnectionReactor keeps watching while reconnecting
         return;
     }
+    if (dispatchMode == ConnectionThread::DispatchMode::SharedThread) {
+        ConnectionReactor *reactor = ConnectionReactor::self();
+        socketWatchedByReactor = reactor && reactor->watchSocket(this, runtimeDir.absoluteFilePath(socketName));
+        if (socketWatchedByReactor) {
+            return;
+        }
+    }
     socketWatcher.reset(new QFileSystemWatcher);
     socketWatcher->addPath(runtimeDir.absoluteFilePath(socketName));
     QObject::connect(socketWatcher.data(), &QFileSystemWatcher::fileChanged, q, [this](const QString &file) {
-        if (QFile::exists(file) || serverDied) {
+        if (QFile::exists(file)) {
             return;
         }
-        qCWarning(KWAYLAND_CLIENT) << "Connection to server went away";
-        serverDied = true;
-        if (display) {
-            free(display);
-            display = nullptr;
-        }
-        socketNotifier.reset();
+        serverSocketRemoved();
+    });
+}
+
+void ConnectionThread::Private::serverSocketRemoved()
+{
+    if (serverDied) {
+        return;
+    }
+    qCWarning(KWAYLAND_CLIENT) << "Connection to server went away";
+    serverDied = true;
+    stopDispatchThread();
+    roundtrips.cancel(false);
+    if (display) {
+        free(display);
+        display = nullptr;
+    }
+    socketNotifier.reset();
+    writeNotifier.reset();
+    flushPending = false;
 
+    if (!socketWatchedByReactor) {
         // need a new filesystem watcher
         socketWatcher.reset(new QFileSystemWatcher);
         socketWatcher->addPath(runtimeDir.absolutePath());
         QObject::connect(socketWatcher.data(), &QFileSystemWatcher::directoryChanged, q, [this]() {
-            if (!serverDied) {
-                return;
-            }
-            if (runtimeDir.exists(socketName)) {
-                qCDebug(KWAYLAND_CLIENT) << "Socket reappeared";
-                socketWatcher.reset();
-                serverDied = false;
-                error = 0;
-                q->initConnection();
-            }
+            serverSocketCreated();
         });
-        Q_EMIT q->connectionDied();
-    });
+    }
+    Q_EMIT q->connectionDied();
+}
+
+void ConnectionThread::Private::serverSocketCreated()
+{
+    if (!serverDied) {
+        return;
+    }
+    if (runtimeDir.exists(socketName)) {
+        qCDebug(KWAYLAND_CLIENT) << "Socket reappeared";
+        socketWatcher.reset();
+        serverDied = false;
+        error = 0;
+        q->initConnection();
+    }
 }
 
 ConnectionThread::ConnectionThread(QObject *parent)
@@ -197,9 +722,7 @@ ConnectionThread::ConnectionThread(QObject *parent)
         &QAbstractEventDispatcher::aboutToBlock,
         this,
         [this] {
-            if (d->display) {
-                wl_display_flush(d->display);
-            }
+            flush();
         },
         Qt::DirectConnection);
 }
@@ -214,6 +737,14 @@ ConnectionThread::ConnectionThread(wl_display *display, QObject *parent)
 
 ConnectionThread::~ConnectionThread()
 {
+    // the worker threads emit signals of the ConnectionThread, so they have to stop before it goes away
+    d->stopDispatchThread();
+    if (d->socketWatchedByReactor) {
+        if (ConnectionReactor *reactor = ConnectionReactor::self()) {
+            reactor->unwatchSocket(d.data());
+        }
+        d->socketWatchedByReactor = false;
+    }
     disconnect(d->eventDispatcherConnection);
 }
 
@@ -260,6 +791,35 @@ void ConnectionThread::setSocketFd(int fd)
     d->fd = fd;
 }
 
+void ConnectionThread::setDispatchMode(DispatchMode mode)
+{
+    if (d->display) {
+        // already initialized
+        return;
+    }
+    d->dispatchMode = mode;
+}
+
+ConnectionThread::DispatchMode ConnectionThread::dispatchMode() const
+{
+    return d->dispatchMode;
+}
+
+void ConnectionThread::setTraceFile(const QString &fileName, qint64 capacity)
+{
+    if (d->display) {
+        // already initialized
+        return;
+    }
+    d->traceFile = fileName;
+    d->traceCapacity = capacity;
+}
+
+QString ConnectionThread::traceFile() const
+{
+    return d->traceFile;
+}
+
 wl_display *ConnectionThread::display()
 {
     return d->display;
@@ -275,7 +835,87 @@ void ConnectionThread::flush()
     if (!d->display) {
         return;
     }
-    wl_display_flush(d->display);
+    if (d->flushPending) {
+        // the write notifier flushes once the socket is writable again
+        return;
+    }
+    const int sent = wl_display_flush(d->display);
+    if (sent == -1 && errno == EAGAIN) {
+        d->setFlushPending();
+    } else if (sent > 0) {
+        if (auto histograms = d->instrumentation.active()) {
+            histograms->flushSize.record(sent);
+        }
+    }
+}
+
+void ConnectionThread::setMaxEventsPerDispatch(int count)
+{
+    d->maxEventsPerDispatch = qMax(0, count);
+}
+
+int ConnectionThread::maxEventsPerDispatch() const
+{
+    return d->maxEventsPerDispatch;
+}
+
+void ConnectionThread::setMaxDispatchTime(int msec)
+{
+    d->maxDispatchTime = qMax(0, msec);
+}
+
+int ConnectionThread::maxDispatchTime() const
+{
+    return d->maxDispatchTime;
+}
+
+quint64 ConnectionThread::dispatchBudgetExceededCount() const
+{
+    return d->dispatchBudgetExceededCount;
+}
+
+void ConnectionThread::setInstrumentationEnabled(bool enabled)
+{
+    if (enabled == d->instrumentation.isEnabled()) {
+        return;
+    }
+    d->instrumentation.setEnabled(enabled);
+    d->readTimestampUsers += enabled ? 1 : -1;
+}
+
+bool ConnectionThread::isInstrumentationEnabled() const
+{
+    return d->instrumentation.isEnabled();
+}
+
+DispatchStatistics ConnectionThread::dispatchStatistics() const
+{
+    return d->instrumentation.snapshot();
+}
+
+void ConnectionThread::resetDispatchStatistics()
+{
+    d->instrumentation.reset();
+}
+
+void ConnectionThread::addReadTimestampUser()
+{
+    ++d->readTimestampUsers;
+}
+
+void ConnectionThread::removeReadTimestampUser()
+{
+    --d->readTimestampUsers;
+}
+
+qint64 ConnectionThread::lastReadTime() const
+{
+    return d->lastReadTime.load(std::memory_order_relaxed);
+}
+
+bool ConnectionThread::isFlushPending() const
+{
+    return d->flushPending;
 }
 
 void ConnectionThread::roundtrip()
@@ -294,9 +934,22 @@ void ConnectionThread::roundtrip()
             }
         }
     }
+    if (auto histograms = d->instrumentation.active()) {
+        const qint64 start = DispatchInstrumentation::now();
+        wl_display_roundtrip(d->display);
+        histograms->blockedTime.record(DispatchInstrumentation::now() - start);
+        return;
+    }
     wl_display_roundtrip(d->display);
 }
 
+QFuture<void> ConnectionThread::asyncRoundtrip()
+{
+    QFuture<void> future = d->roundtrips.start(d->display);
+    flush();
+    return future;
+}
+
 bool ConnectionThread::hasError() const
 {
     return d->error != 0;
@@ -312,6 +965,58 @@ QList<ConnectionThread *> ConnectionThread::connections()
     return Private::connections;
 }
 
+void ConnectionThread::addEventQueue(EventQueue *queue)
+{
+    QMutexLocker lock(&d->eventQueuesMutex);
+    d->eventQueues << queue;
+}
+
+void ConnectionThread::removeEventQueue(EventQueue *queue)
+{
+    QMutexLocker lock(&d->eventQueuesMutex);
+    d->eventQueues.removeOne(queue);
+}
+
+void ConnectionThread::dispatchEventsReadByQueue()
+{
+    d->markEventsRead();
+    // queues waiting in a loop read many times per event loop iteration, one dispatch covers all of them
+    if (d->readDispatchPending.exchange(true)) {
+        return;
+    }
+    QMetaObject::invokeMethod(
+        this,
+        [this] {
+            d->readDispatchPending = false;
+            if (d->display) {
+                d->dispatchReadEvents();
+            }
+        },
+        Qt::QueuedConnection);
+}
+
+void ConnectionThread::wakeUpEventQueues()
+{
+    QList<QPointer<EventQueue>> local;
+    {
+        QMutexLocker lock(&d->eventQueuesMutex);
+        for (EventQueue *queue : std::as_const(d->eventQueues)) {
+            if (queue->thread() == QThread::currentThread()) {
+                local << queue;
+            } else {
+                // cheap enough to do under the lock, which keeps the queue from going away meanwhile
+                queue->wakeUp();
+            }
+        }
+    }
+    // dispatching may create or destroy EventQueues, so don't hold the lock
+    for (const auto &queue : std::as_const(local)) {
+        if (queue) {
+            queue->dispatch();
+        }
+    }
+}
+
 }
 }
 
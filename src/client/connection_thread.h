@@ -6,10 +6,12 @@
 #ifndef WAYLAND_CONNECTION_THREAD_H
 #define WAYLAND_CONNECTION_THREAD_H
 
+#include <QFuture>
 #include <QList>
 #include <QObject>
 
 #include "KWayland/Client/kwaylandclient_export.h"
+#include "dispatchstatistics.h"
 
 struct wl_display;
 
@@ -40,6 +42,8 @@ namespace KWayland
  **/
 namespace Client
 {
+class EventQueue;
+
 /**
  * @short Creates and manages the connection to a Wayland server.
  *
@@ -75,8 +79,24 @@ namespace Client
  * the Wayland socket, it will be dispatched and the signal @link ::eventsRead @endlink is emitted.
  * This allows further event queues in other threads to also dispatch their events.
  *
+ * By default the Wayland socket is read through a QSocketNotifier in the thread the ConnectionThread
+ * lives in. If that thread is busy, e.g. painting, the events of all other event queues get delayed
+ * as well. With DispatchMode::DedicatedThread a worker thread owned by the ConnectionThread reads
+ * the socket instead and hands the events off to the threads of the event queues:
+ *
+ * @code
+ * ConnectionThread *connection = new ConnectionThread;
+ * connection->setDispatchMode(ConnectionThread::DispatchMode::DedicatedThread);
+ * connection->initConnection();
+ * @endcode
+ *
+ * Applications holding many connections can use DispatchMode::SharedThread, which reads all of
+ * them from a single thread.
+ *
  * Furthermore this class flushes the Wayland connection whenever the QAbstractEventDispatcher
- * is about to block.
+ * is about to block. If the socket is full, the ConnectionThread keeps flushing as soon as the
+ * socket becomes writable again and reports this through flushPendingChanged, so that clients
+ * sending bursts of requests can throttle.
  *
  * To disconnect the connection to the Wayland server one should delete the instance of this
  * class and quit the dedicated thread:
@@ -107,6 +127,34 @@ class KWAYLANDCLIENT_EXPORT ConnectionThread : public QObject
 {
     Q_OBJECT
 public:
+    /**
+     * How the events of the Wayland connection get read.
+     * @see setDispatchMode
+     * @since 6.2
+     **/
+    enum class DispatchMode {
+        /**
+         * The Wayland socket is read through a QSocketNotifier in the thread the
+         * ConnectionThread lives in.
+         **/
+        SocketNotifier,
+        /**
+         * The Wayland socket is read by a worker thread owned by the ConnectionThread.
+         * The events of the default queue still get dispatched in the thread the
+         * ConnectionThread lives in.
+         **/
+        DedicatedThread,
+        /**
+         * The Wayland socket is read by a thread shared by all ConnectionThreads with this
+         * DispatchMode, which also watches the Wayland sockets for going away. This keeps the
+         * cost of each additional connection constant, e.g. when connecting to many nested
+         * compositors. The events of the default queue still get dispatched in the thread
+         * the ConnectionThread lives in.
+         **/
+        SharedThread,
+    };
+    Q_ENUM(DispatchMode)
+
     explicit ConnectionThread(QObject *parent = nullptr);
     ~ConnectionThread() override;
 
@@ -159,6 +207,55 @@ public:
      * @see setSocketName
      **/
     void setSocketFd(int fd);
+    /**
+     * Sets how the events of the Wayland connection get read.
+     * Only applies if called before calling initConnection. It has no effect on a
+     * ConnectionThread created through fromApplication.
+     *
+     * With DispatchMode::DedicatedThread and DispatchMode::SharedThread the signal eventsRead
+     * is emitted from the worker thread, so any slot connected with Qt::DirectConnection is
+     * invoked there. With DispatchMode::SharedThread such a slot must not block, as it holds
+     * up reading all connections. It may destroy other ConnectionThreads, but like with any
+     * direct connection not the ConnectionThread emitting the signal.
+     *
+     * @see dispatchMode
+     * @since 6.2
+     **/
+    void setDispatchMode(DispatchMode mode);
+    /**
+     * @returns How the events of the Wayland connection get read, the default is
+     * DispatchMode::SocketNotifier.
+     * @see setDispatchMode
+     * @since 6.2
+     **/
+    DispatchMode dispatchMode() const;
+    /**
+     * Records the Wayland protocol traffic of the connection into @p fileName.
+     * Only applies if called before calling initConnection. It has no effect on a
+     * ConnectionThread created through fromApplication.
+     *
+     * The trace holds the object id, opcode, size, direction and timestamp of every message,
+     * together with its arguments. It is written to a ring buffer of @p capacity bytes
+     * mapped from the file, so once it is full the oldest messages get overwritten and a
+     * crashing client still leaves a usable trace. Traces can be decoded
+     * with kwaylandTraceDecoder.
+     *
+     * If the ConnectionThread reconnects, each further connection gets recorded into
+     * @p fileName with the suffix .1, .2 and so on, keeping the previous recordings.
+     *
+     * Recording forwards all traffic through an additional thread and is meant for debugging
+     * and profiling only. Pass an empty @p fileName to disable recording.
+     *
+     * @see traceFile
+     * @since 6.2
+     **/
+    void setTraceFile(const QString &fileName, qint64 capacity = 64 * 1024 * 1024);
+    /**
+     * @returns The file the protocol traffic gets recorded into, empty if not recording.
+     * @see setTraceFile
+     * @since 6.2
+     **/
+    QString traceFile() const;
 
     /**
      * Trigger a blocking roundtrip to the Wayland server. Ensures that all events are processed
@@ -167,6 +264,28 @@ public:
      * @since 5.4
      **/
     void roundtrip();
+    /**
+     * Triggers a roundtrip to the Wayland server without blocking.
+     *
+     * The returned QFuture finishes once the Wayland server processed all requests sent
+     * before and all events it sent in the meantime got dispatched on the default queue.
+     * This allows e.g. to wait for the globals announced to a Registry while doing other work:
+     * @code
+     * registry->setup();
+     * connection->asyncRoundtrip().then(registry, [registry] {
+     *     // all globals got announced
+     * });
+     * @endcode
+     *
+     * If the connection goes away before the Wayland server answered, the QFuture gets canceled.
+     * This method must be invoked from the thread dispatching the default queue, which is the
+     * thread of the ConnectionThread unless it is created through fromApplication.
+     *
+     * @see roundtrip
+     * @see EventQueue::asyncRoundtrip
+     * @since 6.2
+     **/
+    QFuture<void> asyncRoundtrip();
 
     /**
      * @returns whether the Wayland connection experienced an error
@@ -190,6 +309,91 @@ public:
      **/
     static QList<ConnectionThread *> connections();
 
+    /**
+     * Sets the maximum number of events dispatched on the default queue at once, @c 0 for
+     * no limit, which is the default.
+     *
+     * Once the budget is exceeded the remaining events get dispatched in the next event loop
+     * iteration, so that a storm of events does not block the thread of the ConnectionThread.
+     * Enforcing the budget requires libwayland 1.23, with older versions all events still
+     * get dispatched at once.
+     *
+     * @see setMaxDispatchTime
+     * @see dispatchBudgetExceeded
+     * @since 6.2
+     **/
+    void setMaxEventsPerDispatch(int count);
+    /**
+     * @returns the maximum number of events dispatched on the default queue at once.
+     * @see setMaxEventsPerDispatch
+     * @since 6.2
+     **/
+    int maxEventsPerDispatch() const;
+    /**
+     * Sets the time in milliseconds after which dispatching the default queue yields back to
+     * the event loop, @c 0 for no limit, which is the default.
+     *
+     * Like setMaxEventsPerDispatch this requires libwayland 1.23.
+     *
+     * @see setMaxEventsPerDispatch
+     * @see dispatchBudgetExceeded
+     * @since 6.2
+     **/
+    void setMaxDispatchTime(int msec);
+    /**
+     * @returns the time in milliseconds after which dispatching yields back to the event loop.
+     * @see setMaxDispatchTime
+     * @since 6.2
+     **/
+    int maxDispatchTime() const;
+    /**
+     * @returns how often dispatching the default queue yielded back to the event loop
+     * as the dispatch budget got exceeded.
+     * @see dispatchBudgetExceeded
+     * @since 6.2
+     **/
+    quint64 dispatchBudgetExceededCount() const;
+
+    /**
+     * Enables recording DispatchStatistics for the default queue and the connection.
+     *
+     * The instrumentation is disabled by default and costs nothing but a check then.
+     * This method must be invoked from the thread of the ConnectionThread.
+     *
+     * @see dispatchStatistics
+     * @since 6.2
+     **/
+    void setInstrumentationEnabled(bool enabled);
+    /**
+     * @returns whether DispatchStatistics get recorded
+     * @see setInstrumentationEnabled
+     * @since 6.2
+     **/
+    bool isInstrumentationEnabled() const;
+    /**
+     * @returns A snapshot of the statistics recorded for the default queue and the connection
+     * since the instrumentation got enabled or resetDispatchStatistics got invoked.
+     * This method may be invoked from any thread.
+     *
+     * @see setInstrumentationEnabled
+     * @see EventQueue::dispatchStatistics
+     * @since 6.2
+     **/
+    DispatchStatistics dispatchStatistics() const;
+    /**
+     * Clears all recorded statistics.
+     * @see dispatchStatistics
+     * @since 6.2
+     **/
+    void resetDispatchStatistics();
+
+    /**
+     * @returns whether requests could not be flushed as the socket is full
+     * @see flushPendingChanged
+     * @since 6.2
+     **/
+    bool isFlushPending() const;
+
 public Q_SLOTS:
     /**
      * Initializes the connection in an asynchronous way.
@@ -203,6 +407,9 @@ public Q_SLOTS:
 
     /**
      * Explicitly flush the Wayland display.
+     * If the socket is full, the remaining requests get flushed once it becomes writable.
+     * This method may be invoked from any thread.
+     * @see isFlushPending
      * @since 5.3
      **/
     void flush();
@@ -220,6 +427,7 @@ Q_SIGNALS:
     void failed();
     /**
      * Emitted whenever new events are ready to be read.
+     * With DispatchMode::DedicatedThread or DispatchMode::SharedThread it is emitted from the worker thread.
      **/
     void eventsRead();
     /**
@@ -237,6 +445,25 @@ Q_SIGNALS:
      * @since 5.23
      **/
     void errorOccurred();
+    /**
+     * Emitted when the socket got full while flushing with @p pending @c true, and with
+     * @p pending @c false once all requests got flushed. Clients sending many requests
+     * should stop sending further ones while a flush is pending.
+     *
+     * @see isFlushPending
+     * @since 6.2
+     **/
+    void flushPendingChanged(bool pending);
+    /**
+     * Emitted whenever dispatching the default queue yielded back to the event loop as
+     * the dispatch budget got exceeded, that is events were still pending once it got used up.
+     *
+     * @see setMaxEventsPerDispatch
+     * @see setMaxDispatchTime
+     * @see dispatchBudgetExceededCount
+     * @since 6.2
+     **/
+    void dispatchBudgetExceeded();
 
 protected:
     /*
@@ -252,6 +479,25 @@ private Q_SLOTS:
     void doInitConnection();
 
 private:
+    friend class EventQueue;
+    void addEventQueue(EventQueue *queue);
+    void removeEventQueue(EventQueue *queue);
+    /**
+     * Dispatches the EventQueues living in the current thread and wakes up all others.
+     **/
+    void wakeUpEventQueues();
+    /**
+     * Dispatches the default queue like after reading the socket, once an EventQueue read
+     * the events. May be invoked from any thread, invocations before the dispatch happened
+     * are coalesced.
+     **/
+    void dispatchEventsReadByQueue();
+    /**
+     * An EventQueue measuring the read to dispatch latency needs lastReadTime to be recorded.
+     **/
+    void addReadTimestampUser();
+    void removeReadTimestampUser();
+    qint64 lastReadTime() const;
     class Private;
     QScopedPointer<Private> d;
 };
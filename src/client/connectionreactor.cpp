@@ -0,0 +1,336 @@
+/*
+    SPDX-FileCopyrightText: 2026 Lingmo OS Team
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+#include "connectionreactor_p.h"
+#include "logging.h"
+// Qt
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QThread>
+// system
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iterator>
+
+namespace KWayland
+{
+namespace Client
+{
+Q_GLOBAL_STATIC(ConnectionReactor, s_reactor)
+
+ConnectionReactor::ConnectionReactor() = default;
+
+ConnectionReactor::~ConnectionReactor()
+{
+    if (m_thread) {
+        {
+            QMutexLocker lock(&m_mutex);
+            m_quit = true;
+        }
+        wakeUp();
+        m_thread->wait();
+        delete m_thread;
+    }
+    qDeleteAll(m_readers);
+    for (int fd : {m_epollFd, m_wakeupFd, m_inotifyFd}) {
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+}
+
+ConnectionReactor *ConnectionReactor::self()
+{
+    return s_reactor();
+}
+
+bool ConnectionReactor::ensureRunning()
+{
+    if (m_thread) {
+        // the thread quits on failure
+        return !m_quit;
+    }
+    if (m_epollFd == -1) {
+        m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    }
+    if (m_wakeupFd == -1) {
+        m_wakeupFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    }
+    if (m_epollFd == -1 || m_wakeupFd == -1) {
+        qCWarning(KWAYLAND_CLIENT) << "Could not set up the shared dispatch thread:" << strerror(errno);
+        return false;
+    }
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.ptr = &m_wakeupFd;
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_wakeupFd, &event) == -1) {
+        qCWarning(KWAYLAND_CLIENT) << "Could not set up the shared dispatch thread:" << strerror(errno);
+        return false;
+    }
+    m_thread = QThread::create([this] {
+        run();
+    });
+    m_thread->setObjectName(QStringLiteral("KWaylandReactor"));
+    m_running = true;
+    m_thread->start();
+    return true;
+}
+
+void ConnectionReactor::wakeUp()
+{
+    const uint64_t value = 1;
+    if (write(m_wakeupFd, &value, sizeof(value)) < 0) {
+        qCWarning(KWAYLAND_CLIENT) << "Could not wake up the shared dispatch thread";
+    }
+}
+
+bool ConnectionReactor::addConnection(Connection *connection, int fd)
+{
+    QMutexLocker lock(&m_mutex);
+    if (!ensureRunning()) {
+        return false;
+    }
+    Reader *reader = new Reader{connection, fd};
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.ptr = reader;
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &event) == -1) {
+        qCWarning(KWAYLAND_CLIENT) << "Could not watch the Wayland socket:" << strerror(errno);
+        delete reader;
+        return false;
+    }
+    m_readers.append(reader);
+    // gets the read prepared
+    wakeUp();
+    return true;
+}
+
+ConnectionReactor::Reader *ConnectionReactor::findReader(Connection *connection) const
+{
+    auto it = std::find_if(m_readers.cbegin(), m_readers.cend(), [connection](const Reader *reader) {
+        return reader->connection == connection && !reader->removed;
+    });
+    return it == m_readers.cend() ? nullptr : *it;
+}
+
+void ConnectionReactor::dropRemovedReaders()
+{
+    const qsizetype count = m_readers.size();
+    m_readers.removeIf([this](Reader *reader) {
+        if (!reader->removed) {
+            return false;
+        }
+        if (reader->prepared) {
+            // removeConnection waits for this, so the Connection still exists
+            reader->connection->readEvents(false);
+        }
+        delete reader;
+        return true;
+    });
+    if (m_readers.size() != count) {
+        m_readersRemoved.wakeAll();
+    }
+}
+
+void ConnectionReactor::removeConnection(Connection *connection)
+{
+    QMutexLocker lock(&m_mutex);
+    Reader *reader = findReader(connection);
+    if (!reader) {
+        return;
+    }
+    // the socket may get closed and its number reused right after returning
+    if (!reader->broken) {
+        epoll_ctl(m_epollFd, EPOLL_CTL_DEL, reader->fd, nullptr);
+    }
+    reader->removed = true;
+    if (!m_running) {
+        m_readers.removeOne(reader);
+        delete reader;
+        return;
+    }
+    // the thread might still hold the Reader in its events, so it gets deleted by the thread
+    if (QThread::currentThread() == m_thread) {
+        // the thread cannot wait for itself, a Reader being read gets its prepared state reset afterwards
+        if (reader->prepared && reader != m_reading) {
+            connection->readEvents(false);
+            reader->prepared = false;
+        }
+        return;
+    }
+    if (!reader->prepared) {
+        return;
+    }
+    // the prepared read has to be canceled before the connection goes away
+    wakeUp();
+    // a new Reader might get allocated at the same address, but is not removed
+    while (std::any_of(m_readers.cbegin(), m_readers.cend(), [reader](const Reader *other) {
+        return other == reader && other->removed;
+    })) {
+        m_readersRemoved.wait(&m_mutex);
+    }
+}
+
+bool ConnectionReactor::watchSocket(Connection *connection, const QString &fileName)
+{
+    unwatchSocket(connection);
+    QMutexLocker lock(&m_mutex);
+    if (!ensureRunning()) {
+        return false;
+    }
+    if (m_inotifyFd == -1) {
+        m_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (m_inotifyFd == -1) {
+            qCWarning(KWAYLAND_CLIENT) << "Could not watch the Wayland socket:" << strerror(errno);
+            return false;
+        }
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.ptr = &m_inotifyFd;
+        if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_inotifyFd, &event) == -1) {
+            qCWarning(KWAYLAND_CLIENT) << "Could not watch the Wayland socket:" << strerror(errno);
+            close(m_inotifyFd);
+            m_inotifyFd = -1;
+            return false;
+        }
+    }
+    const QFileInfo info(fileName);
+    // watching the same directory again returns the existing descriptor
+    const int descriptor =
+        inotify_add_watch(m_inotifyFd, QFile::encodeName(info.absolutePath()).constData(), IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO);
+    if (descriptor == -1) {
+        qCWarning(KWAYLAND_CLIENT) << "Could not watch the Wayland socket:" << strerror(errno);
+        return false;
+    }
+    m_watches.append(Watch{connection, descriptor, QFile::encodeName(info.fileName())});
+    return true;
+}
+
+void ConnectionReactor::unwatchSocket(Connection *connection)
+{
+    QMutexLocker lock(&m_mutex);
+    auto it = std::find_if(m_watches.begin(), m_watches.end(), [connection](const Watch &watch) {
+        return watch.connection == connection;
+    });
+    if (it == m_watches.end()) {
+        return;
+    }
+    const int descriptor = it->descriptor;
+    m_watches.erase(it);
+    if (std::none_of(m_watches.cbegin(), m_watches.cend(), [descriptor](const Watch &watch) {
+            return watch.descriptor == descriptor;
+        })) {
+        inotify_rm_watch(m_inotifyFd, descriptor);
+    }
+}
+
+void ConnectionReactor::run()
+{
+    struct epoll_event events[32];
+    QMutexLocker lock(&m_mutex);
+    while (!m_quit) {
+        dropRemovedReaders();
+        // a read stays prepared until the socket gets readable, wakeups do not touch it
+        for (Reader *reader : std::as_const(m_readers)) {
+            if (!reader->prepared && !reader->broken) {
+                reader->connection->prepareRead();
+                reader->prepared = true;
+            }
+        }
+
+        lock.unlock();
+        const int ready = epoll_wait(m_epollFd, events, std::size(events), -1);
+        lock.relock();
+        if (ready == -1 && errno != EINTR) {
+            qCWarning(KWAYLAND_CLIENT) << "Shared dispatch thread failed:" << strerror(errno);
+            m_quit = true;
+        }
+
+        bool socketsChanged = false;
+        for (int i = 0; i < ready; ++i) {
+            if (events[i].data.ptr == &m_wakeupFd) {
+                uint64_t value;
+                if (read(m_wakeupFd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+                    qCWarning(KWAYLAND_CLIENT) << "Could not read the eventfd of the shared dispatch thread";
+                }
+                continue;
+            }
+            if (events[i].data.ptr == &m_inotifyFd) {
+                socketsChanged = true;
+                continue;
+            }
+            Reader *reader = static_cast<Reader *>(events[i].data.ptr);
+            if (reader->removed || !reader->prepared) {
+                // removed by a previous read
+                continue;
+            }
+            // the read happens without holding the lock, as it emits eventsRead and a directly
+            // connected slot might add or remove connections
+            m_reading = reader;
+            lock.unlock();
+            const bool intact = reader->connection->readEvents(true);
+            lock.relock();
+            m_reading = nullptr;
+            reader->prepared = false;
+            if (!intact) {
+                reader->broken = true;
+                if (!reader->removed) {
+                    epoll_ctl(m_epollFd, EPOLL_CTL_DEL, reader->fd, nullptr);
+                }
+            }
+        }
+        if (socketsChanged) {
+            handleSocketChanges();
+        }
+    }
+    // the Connections which were not removed still exist, so their reads can be canceled
+    for (Reader *reader : std::as_const(m_readers)) {
+        if (reader->prepared) {
+            reader->connection->readEvents(false);
+            reader->prepared = false;
+        }
+    }
+    dropRemovedReaders();
+    m_running = false;
+}
+
+void ConnectionReactor::handleSocketChanges()
+{
+    alignas(struct inotify_event) char buffer[4096];
+    while (true) {
+        const ssize_t length = read(m_inotifyFd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            return;
+        }
+        for (ssize_t offset = 0; offset < length;) {
+            const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(buffer + offset);
+            offset += sizeof(struct inotify_event) + event->len;
+            if (event->len == 0) {
+                continue;
+            }
+            const QByteArray name(event->name);
+            for (const Watch &watch : std::as_const(m_watches)) {
+                if (watch.descriptor != event->wd || watch.name != name) {
+                    continue;
+                }
+                if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                    watch.connection->socketRemoved();
+                } else if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                    watch.connection->socketCreated();
+                }
+            }
+        }
+    }
+}
+
+}
+}
@@ -0,0 +1,134 @@
+/*
+    SPDX-FileCopyrightText: 2026 Lingmo OS Team
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+#ifndef WAYLAND_CONNECTIONREACTOR_P_H
+#define WAYLAND_CONNECTIONREACTOR_P_H
+
+#include <QByteArray>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QWaitCondition>
+
+class QThread;
+
+namespace KWayland
+{
+namespace Client
+{
+/**
+ * Reads the events of many Wayland connections and watches their sockets for going away
+ * from a single thread, using one epoll and one inotify instance for all of them.
+ *
+ * Used by the ConnectionThreads with ConnectionThread::DispatchMode::SharedThread.
+ **/
+class Q_DECL_HIDDEN ConnectionReactor
+{
+public:
+    /**
+     * Implemented by the connections handled by the ConnectionReactor.
+     * All methods get invoked from the thread of the ConnectionReactor.
+     **/
+    class Connection
+    {
+    public:
+        virtual ~Connection() = default;
+        /**
+         * Prepares reading the events, see wl_display_prepare_read_queue.
+         **/
+        virtual void prepareRead() = 0;
+        /**
+         * Reads the events if @p readable, otherwise cancels the prepared read.
+         * @returns @c false if the connection broke and must not be read anymore.
+         **/
+        virtual bool readEvents(bool readable) = 0;
+        /**
+         * The watched Wayland socket got removed.
+         **/
+        virtual void socketRemoved() = 0;
+        /**
+         * The watched Wayland socket got created again.
+         **/
+        virtual void socketCreated() = 0;
+    };
+
+    ConnectionReactor();
+    ~ConnectionReactor();
+
+    /**
+     * @returns The ConnectionReactor shared by all connections, @c nullptr while the application exits.
+     **/
+    static ConnectionReactor *self();
+
+    /**
+     * Starts reading the events of @p connection once its socket @p fd is readable.
+     * @returns @c false if the ConnectionReactor could not be set up.
+     **/
+    bool addConnection(Connection *connection, int fd);
+    /**
+     * Stops reading the events of @p connection.
+     * Blocks until a read prepared for @p connection got canceled. If invoked from the thread
+     * of the ConnectionReactor, e.g. from a slot connected directly to a signal emitted while
+     * reading, it does not block.
+     **/
+    void removeConnection(Connection *connection);
+    /**
+     * Watches the Wayland socket @p fileName for @p connection, replacing a previous watch.
+     * @returns @c false if the socket cannot be watched.
+     **/
+    bool watchSocket(Connection *connection, const QString &fileName);
+    /**
+     * Stops watching the Wayland socket of @p connection. No Connection method gets invoked
+     * for a socket change afterwards.
+     **/
+    void unwatchSocket(Connection *connection);
+
+private:
+    bool ensureRunning();
+    void run();
+    void wakeUp();
+    void handleSocketChanges();
+
+    // referenced by the epoll_event of its socket, only deleted by dropRemovedReaders
+    struct Reader {
+        Connection *connection;
+        int fd;
+        // read prepared until the socket gets readable
+        bool prepared = false;
+        bool broken = false;
+        bool removed = false;
+    };
+    struct Watch {
+        Connection *connection;
+        int descriptor;
+        QByteArray name;
+    };
+    Reader *findReader(Connection *connection) const;
+    /**
+     * Cancels the reads prepared for removed Readers and deletes them.
+     **/
+    void dropRemovedReaders();
+
+    QMutex m_mutex;
+    // signaled whenever removed Readers got dropped
+    QWaitCondition m_readersRemoved;
+    QList<Reader *> m_readers;
+    QList<Watch> m_watches;
+    QThread *m_thread = nullptr;
+    // the Reader read while the lock is released
+    Reader *m_reading = nullptr;
+    int m_epollFd = -1;
+    // eventfd to wake up the thread for changes to the readers or quitting
+    int m_wakeupFd = -1;
+    int m_inotifyFd = -1;
+    bool m_quit = false;
+    // whether run() still handles the Readers
+    bool m_running = false;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,132 @@
+/*
+    SPDX-FileCopyrightText: 2026 Lingmo OS Team
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+#include "dispatchstatistics.h"
+#include "dispatchstatistics_p.h"
+// Qt
+#include <QtAlgorithms>
+
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+namespace KWayland
+{
+namespace Client
+{
+quint64 DispatchHistogram::bucketUpperBound(int bucket)
+{
+    if (bucket <= 0) {
+        return 0;
+    }
+    if (bucket >= BucketCount - 1) {
+        return std::numeric_limits<quint64>::max();
+    }
+    return (quint64(1) << bucket) - 1;
+}
+
+qreal DispatchHistogram::mean() const
+{
+    return count == 0 ? 0 : qreal(sum) / count;
+}
+
+quint64 DispatchHistogram::percentile(qreal p) const
+{
+    if (count == 0) {
+        return 0;
+    }
+    const quint64 rank = qBound<quint64>(1, std::ceil(p * count), count);
+    quint64 seen = 0;
+    for (int i = 0; i < BucketCount; ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            return qMin(bucketUpperBound(i), max);
+        }
+    }
+    return max;
+}
+
+AtomicHistogram::AtomicHistogram()
+{
+    reset();
+}
+
+void AtomicHistogram::record(quint64 value)
+{
+    const int bucket = value == 0 ? 0 : qMin(64 - qCountLeadingZeroBits(value), DispatchHistogram::BucketCount - 1);
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(value, std::memory_order_relaxed);
+    quint64 currentMax = max.load(std::memory_order_relaxed);
+    while (value > currentMax && !max.compare_exchange_weak(currentMax, value, std::memory_order_relaxed)) { }
+}
+
+DispatchHistogram AtomicHistogram::snapshot() const
+{
+    // the values are read one by one, a value recorded meanwhile might only show up partially
+    DispatchHistogram histogram;
+    for (int i = 0; i < DispatchHistogram::BucketCount; ++i) {
+        histogram.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+    }
+    histogram.count = count.load(std::memory_order_relaxed);
+    histogram.sum = sum.load(std::memory_order_relaxed);
+    histogram.max = max.load(std::memory_order_relaxed);
+    return histogram;
+}
+
+void AtomicHistogram::reset()
+{
+    for (auto &bucket : buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    count.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+    max.store(0, std::memory_order_relaxed);
+}
+
+DispatchInstrumentation::~DispatchInstrumentation()
+{
+    delete histograms.load();
+}
+
+void DispatchInstrumentation::setEnabled(bool enable)
+{
+    if (enable && !histograms.load(std::memory_order_relaxed)) {
+        histograms.store(new Histograms, std::memory_order_release);
+    }
+    enabled.store(enable, std::memory_order_relaxed);
+}
+
+DispatchStatistics DispatchInstrumentation::snapshot() const
+{
+    DispatchStatistics statistics;
+    if (const Histograms *h = histograms.load(std::memory_order_acquire)) {
+        statistics.readToDispatchLatency = h->readToDispatchLatency.snapshot();
+        statistics.dispatchDuration = h->dispatchDuration.snapshot();
+        statistics.eventsPerWakeup = h->eventsPerWakeup.snapshot();
+        statistics.flushSize = h->flushSize.snapshot();
+        statistics.blockedTime = h->blockedTime.snapshot();
+    }
+    return statistics;
+}
+
+void DispatchInstrumentation::reset()
+{
+    if (Histograms *h = histograms.load(std::memory_order_acquire)) {
+        h->readToDispatchLatency.reset();
+        h->dispatchDuration.reset();
+        h->eventsPerWakeup.reset();
+        h->flushSize.reset();
+        h->blockedTime.reset();
+    }
+}
+
+qint64 DispatchInstrumentation::now()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}
+}
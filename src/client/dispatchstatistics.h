@@ -0,0 +1,103 @@
+/*
+    SPDX-FileCopyrightText: 2026 Lingmo OS Team
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+#ifndef WAYLAND_DISPATCHSTATISTICS_H
+#define WAYLAND_DISPATCHSTATISTICS_H
+
+#include <QtGlobal>
+
+#include <array>
+
+#include "KWayland/Client/kwaylandclient_export.h"
+
+namespace KWayland
+{
+namespace Client
+{
+/**
+ * @short Snapshot of a histogram recorded while dispatching events.
+ *
+ * The values are sorted into buckets of exponentially growing size. Bucket @c 0 holds
+ * the value @c 0, every further bucket @c i holds the values from @c 2^(i-1) up to
+ * bucketUpperBound(i). The last bucket holds all larger values.
+ *
+ * @see DispatchStatistics
+ * @since 6.2
+ **/
+class KWAYLANDCLIENT_EXPORT DispatchHistogram
+{
+public:
+    static constexpr int BucketCount = 32;
+
+    /**
+     * The number of recorded values.
+     **/
+    quint64 count = 0;
+    /**
+     * The sum of all recorded values.
+     **/
+    quint64 sum = 0;
+    /**
+     * The largest recorded value.
+     **/
+    quint64 max = 0;
+    /**
+     * The number of recorded values per bucket.
+     **/
+    std::array<quint64, BucketCount> buckets = {};
+
+    /**
+     * @returns The largest value sorted into @p bucket.
+     **/
+    static quint64 bucketUpperBound(int bucket);
+    /**
+     * @returns The average of all recorded values, @c 0 if nothing got recorded.
+     **/
+    qreal mean() const;
+    /**
+     * @returns An upper bound of the value below which the fraction @p p of all recorded
+     * values lies, e.g. @c 0.99 for the 99th percentile.
+     **/
+    quint64 percentile(qreal p) const;
+};
+
+/**
+ * @short Snapshot of the statistics recorded while dispatching events.
+ *
+ * Durations are in microseconds.
+ *
+ * @see ConnectionThread::dispatchStatistics
+ * @see EventQueue::dispatchStatistics
+ * @since 6.2
+ **/
+class KWAYLANDCLIENT_EXPORT DispatchStatistics
+{
+public:
+    /**
+     * The time between reading events from the Wayland socket and starting to dispatch them.
+     **/
+    DispatchHistogram readToDispatchLatency;
+    /**
+     * The time it took to dispatch the events of the queue.
+     **/
+    DispatchHistogram dispatchDuration;
+    /**
+     * The number of events dispatched at once.
+     **/
+    DispatchHistogram eventsPerWakeup;
+    /**
+     * The number of bytes sent per flush of the connection. Only recorded by the ConnectionThread.
+     **/
+    DispatchHistogram flushSize;
+    /**
+     * The time blocked in ConnectionThread::roundtrip respectively EventQueue::waitForEvents.
+     **/
+    DispatchHistogram blockedTime;
+};
+
+}
+}
+
+#endif
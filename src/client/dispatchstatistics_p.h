@@ -0,0 +1,88 @@
+/*
+    SPDX-FileCopyrightText: 2026 Lingmo OS Team
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+#ifndef WAYLAND_DISPATCHSTATISTICS_P_H
+#define WAYLAND_DISPATCHSTATISTICS_P_H
+
+#include "dispatchstatistics.h"
+
+#include <atomic>
+
+namespace KWayland
+{
+namespace Client
+{
+/**
+ * Histogram which can be recorded into from any thread without locking.
+ **/
+class Q_DECL_HIDDEN AtomicHistogram
+{
+public:
+    AtomicHistogram();
+    void record(quint64 value);
+    DispatchHistogram snapshot() const;
+    void reset();
+
+private:
+    std::array<std::atomic<quint64>, DispatchHistogram::BucketCount> buckets;
+    std::atomic<quint64> count;
+    std::atomic<quint64> sum;
+    std::atomic<quint64> max;
+};
+
+/**
+ * Opt-in instrumentation of dispatching events.
+ *
+ * The histograms only get allocated once the instrumentation gets enabled for the first
+ * time and are kept afterwards, so that threads still recording do not access freed memory.
+ * While disabled, checking for it is a single atomic load.
+ **/
+class Q_DECL_HIDDEN DispatchInstrumentation
+{
+public:
+    struct Histograms {
+        AtomicHistogram readToDispatchLatency;
+        AtomicHistogram dispatchDuration;
+        AtomicHistogram eventsPerWakeup;
+        AtomicHistogram flushSize;
+        AtomicHistogram blockedTime;
+    };
+
+    DispatchInstrumentation() = default;
+    DispatchInstrumentation(const DispatchInstrumentation &) = delete;
+    ~DispatchInstrumentation();
+
+    /**
+     * @returns The histograms to record into, @c null while the instrumentation is disabled.
+     **/
+    Histograms *active() const
+    {
+        return enabled.load(std::memory_order_relaxed) ? histograms.load(std::memory_order_acquire) : nullptr;
+    }
+    bool isEnabled() const
+    {
+        return enabled.load(std::memory_order_relaxed);
+    }
+    /**
+     * Must be invoked from one thread only.
+     **/
+    void setEnabled(bool enable);
+    DispatchStatistics snapshot() const;
+    void reset();
+
+    /**
+     * @returns A monotonic timestamp in microseconds.
+     **/
+    static qint64 now();
+
+private:
+    std::atomic<Histograms *> histograms{nullptr};
+    std::atomic<bool> enabled{false};
+};
+
+}
+}
+
+#endif
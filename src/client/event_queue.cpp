@@ -5,10 +5,23 @@
 */
 #include "event_queue.h"
 #include "connection_thread.h"
+#include "dispatchstatistics_p.h"
+#include "roundtrip_p.h"
 #include "wayland_pointer_p.h"
 
+#include <QDeadlineTimer>
+#include <QPointer>
+#include <QSocketNotifier>
+
 #include <wayland-client.h>
 
+#include <atomic>
+
+#include <errno.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
 namespace KWayland
 {
 namespace Client
@@ -18,8 +31,105 @@ class Q_DECL_HIDDEN EventQueue::Private
 public:
     wl_display *display = nullptr;
     WaylandPointer<wl_event_queue, wl_event_queue_destroy> queue;
+    QPointer<ConnectionThread> connection;
+    // eventfd the ConnectionThread writes to for waking up the thread of the EventQueue
+    int wakeupFd = -1;
+    QScopedPointer<QSocketNotifier> wakeupNotifier;
+    // set while a wake up did not get handled yet, so that it is written only once
+    std::atomic<bool> wakeupPending{false};
+    PendingRoundtrips roundtrips;
+    DispatchInstrumentation instrumentation;
+    // whether the connection got asked to record when events got read
+    bool readTimestampUser = false;
+    // read time of the events last dispatched
+    qint64 lastDispatchedReadTime = 0;
+    void updateReadTimestampUser();
+    void setupWakeup(EventQueue *q);
+    void releaseWakeup(EventQueue *q);
 };
 
+void EventQueue::Private::setupWakeup(EventQueue *q)
+{
+    wakeupFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (wakeupFd == -1) {
+        // fall back to a queued signal, which costs a metacall per batch of events
+        QObject::connect(connection, &ConnectionThread::eventsRead, q, &EventQueue::dispatch, Qt::QueuedConnection);
+        return;
+    }
+    wakeupNotifier.reset(new QSocketNotifier(wakeupFd, QSocketNotifier::Read, q));
+    QObject::connect(wakeupNotifier.data(), &QSocketNotifier::activated, q, [this, q] {
+        uint64_t value;
+        if (read(wakeupFd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+            return;
+        }
+        // events read from now on need another wake up
+        wakeupPending = false;
+        q->dispatch();
+    });
+    connection->addEventQueue(q);
+}
+
+void EventQueue::Private::updateReadTimestampUser()
+{
+    const bool needed = connection && instrumentation.isEnabled();
+    if (needed == readTimestampUser) {
+        return;
+    }
+    if (needed) {
+        connection->addReadTimestampUser();
+    } else if (connection) {
+        connection->removeReadTimestampUser();
+    }
+    readTimestampUser = needed;
+}
+
+namespace
+{
+/**
+ * Records the time until going out of scope as blocked time.
+ **/
+class BlockedTimeRecorder
+{
+public:
+    explicit BlockedTimeRecorder(DispatchInstrumentation::Histograms *histograms)
+        : m_histograms(histograms)
+        , m_start(histograms ? DispatchInstrumentation::now() : 0)
+    {
+    }
+    ~BlockedTimeRecorder()
+    {
+        if (m_histograms) {
+            m_histograms->blockedTime.record(DispatchInstrumentation::now() - m_start);
+        }
+    }
+
+private:
+    DispatchInstrumentation::Histograms *m_histograms;
+    qint64 m_start;
+};
+}
+
+void EventQueue::Private::releaseWakeup(EventQueue *q)
+{
+    if (readTimestampUser && connection) {
+        connection->removeReadTimestampUser();
+    }
+    readTimestampUser = false;
+    if (connection) {
+        QObject::disconnect(connection, &ConnectionThread::eventsRead, q, &EventQueue::dispatch);
+        if (wakeupFd != -1) {
+            connection->removeEventQueue(q);
+        }
+    }
+    connection.clear();
+    wakeupNotifier.reset();
+    if (wakeupFd != -1) {
+        close(wakeupFd);
+        wakeupFd = -1;
+    }
+    wakeupPending = false;
+}
+
 EventQueue::EventQueue(QObject *parent)
     : QObject(parent)
     , d(new Private)
@@ -33,12 +143,18 @@ EventQueue::~EventQueue()
 
 void EventQueue::release()
 {
+    if (d->queue) {
+        d->roundtrips.cancel();
+    }
+    d->releaseWakeup(this);
     d->queue.release();
     d->display = nullptr;
 }
 
 void EventQueue::destroy()
 {
+    d->roundtrips.cancel(false);
+    d->releaseWakeup(this);
     d->queue.destroy();
     d->display = nullptr;
 }
@@ -60,7 +176,21 @@ void EventQueue::setup(wl_display *display)
 void EventQueue::setup(ConnectionThread *connection)
 {
     setup(connection->display());
-    connect(connection, &ConnectionThread::eventsRead, this, &EventQueue::dispatch, Qt::QueuedConnection);
+    d->connection = connection;
+    d->setupWakeup(this);
+    d->updateReadTimestampUser();
+}
+
+void EventQueue::wakeUp()
+{
+    if (d->wakeupPending.exchange(true)) {
+        // the thread of the EventQueue did not dispatch since the last wake up yet
+        return;
+    }
+    const uint64_t value = 1;
+    if (write(d->wakeupFd, &value, sizeof(value)) < 0) {
+        d->wakeupPending = false;
+    }
 }
 
 void EventQueue::dispatch()
@@ -68,8 +198,99 @@ void EventQueue::dispatch()
     if (!d->display || !d->queue) {
         return;
     }
-    wl_display_dispatch_queue_pending(d->display, d->queue);
-    wl_display_flush(d->display);
+    if (auto histograms = d->instrumentation.active()) {
+        const qint64 start = DispatchInstrumentation::now();
+        const qint64 readTime = d->connection ? d->connection->lastReadTime() : 0;
+        if (readTime > d->lastDispatchedReadTime) {
+            histograms->readToDispatchLatency.record(start - readTime);
+            d->lastDispatchedReadTime = readTime;
+        }
+        const int count = wl_display_dispatch_queue_pending(d->display, d->queue);
+        if (count > 0) {
+            histograms->eventsPerWakeup.record(count);
+            histograms->dispatchDuration.record(DispatchInstrumentation::now() - start);
+        }
+    } else {
+        wl_display_dispatch_queue_pending(d->display, d->queue);
+    }
+    if (d->connection) {
+        d->connection->flush();
+    } else {
+        wl_display_flush(d->display);
+    }
+}
+
+bool EventQueue::waitForEvents(int timeout)
+{
+    if (!d->display || !d->queue) {
+        return false;
+    }
+    BlockedTimeRecorder recorder(d->instrumentation.active());
+    const QDeadlineTimer deadline(timeout);
+    while (true) {
+        while (wl_display_prepare_read_queue(d->display, d->queue) != 0) {
+            const int dispatched = wl_display_dispatch_queue_pending(d->display, d->queue);
+            if (dispatched != 0) {
+                wl_display_flush(d->display);
+                return dispatched > 0;
+            }
+        }
+        wl_display_flush(d->display);
+        struct pollfd pfd;
+        pfd.fd = wl_display_get_fd(d->display);
+        pfd.events = POLLIN;
+        int ret;
+        do {
+            ret = poll(&pfd, 1, deadline.isForever() ? -1 : int(deadline.remainingTime()));
+        } while (ret == -1 && errno == EINTR);
+        if (ret <= 0) {
+            wl_display_cancel_read(d->display);
+            return false;
+        }
+        if (wl_display_read_events(d->display) == -1) {
+            return false;
+        }
+        if (d->connection) {
+            // the events for the other queues got read as well, they wouldn't get noticed otherwise
+            d->connection->dispatchEventsReadByQueue();
+        }
+        // the events read might all belong to other queues, keep waiting in that case
+    }
+}
+
+QFuture<void> EventQueue::asyncRoundtrip()
+{
+    if (!d->queue) {
+        return d->roundtrips.start(nullptr);
+    }
+    QFuture<void> future = d->roundtrips.start(d->display, d->queue);
+    if (d->connection) {
+        d->connection->flush();
+    } else {
+        wl_display_flush(d->display);
+    }
+    return future;
+}
+
+void EventQueue::setInstrumentationEnabled(bool enabled)
+{
+    d->instrumentation.setEnabled(enabled);
+    d->updateReadTimestampUser();
+}
+
+bool EventQueue::isInstrumentationEnabled() const
+{
+    return d->instrumentation.isEnabled();
+}
+
+DispatchStatistics EventQueue::dispatchStatistics() const
+{
+    return d->instrumentation.snapshot();
+}
+
+void EventQueue::resetDispatchStatistics()
+{
+    d->instrumentation.reset();
 }
 
 void EventQueue::addProxy(wl_proxy *proxy)
@@ -6,9 +6,11 @@
 #ifndef WAYLAND_EVENT_QUEUE_H
 #define WAYLAND_EVENT_QUEUE_H
 
+#include <QFuture>
 #include <QObject>
 
 #include "KWayland/Client/kwaylandclient_export.h"
+#include "dispatchstatistics.h"
 
 struct wl_display;
 struct wl_proxy;
@@ -70,9 +72,11 @@ public:
     /**
      * Creates the event queue for the @p connection.
      *
-     * This method also connects the eventsRead signal of the ConnectionThread
-     * to the dispatch method. Events will be automatically dispatched without
-     * the need to call dispatch manually.
+     * The EventQueue gets woken up by the ConnectionThread whenever new events got read.
+     * Events will be automatically dispatched without the need to call dispatch manually.
+     * If the EventQueue lives in the thread reading the events, they are dispatched right
+     * away. Otherwise the thread of the EventQueue gets woken up through an eventfd, once
+     * for all events read until it dispatches.
      * @see dispatch
      **/
     void setup(ConnectionThread *connection);
@@ -115,6 +119,65 @@ public:
     template<typename wl_interface, typename T>
     void addProxy(T *proxy);
 
+    /**
+     * Waits for events on this EventQueue and dispatches them.
+     *
+     * If there are no pending events, this method reads from the Wayland connection until
+     * events for this EventQueue arrive or @p timeout milliseconds passed. A negative
+     * @p timeout waits forever. Events read for other queues are left to the ConnectionThread
+     * this EventQueue was set up for.
+     *
+     * @returns @c true if events got dispatched, @c false on timeout or error
+     * @see dispatch
+     * @since 6.2
+     **/
+    bool waitForEvents(int timeout = -1);
+    /**
+     * Triggers a roundtrip to the Wayland server without blocking.
+     *
+     * The returned QFuture finishes once the Wayland server processed all requests sent
+     * before and all events it sent in the meantime got dispatched on this EventQueue.
+     * If the EventQueue gets released or destroyed before, the QFuture gets canceled.
+     * This method must be invoked from the thread dispatching this EventQueue.
+     *
+     * @see ConnectionThread::asyncRoundtrip
+     * @since 6.2
+     **/
+    QFuture<void> asyncRoundtrip();
+
+    /**
+     * Enables recording DispatchStatistics for this EventQueue.
+     *
+     * The instrumentation is disabled by default and costs nothing but a check then. The read
+     * to dispatch latency is only recorded if the EventQueue got set up for a ConnectionThread.
+     * This method must be invoked from the thread of the EventQueue.
+     *
+     * @see dispatchStatistics
+     * @since 6.2
+     **/
+    void setInstrumentationEnabled(bool enabled);
+    /**
+     * @returns whether DispatchStatistics get recorded
+     * @see setInstrumentationEnabled
+     * @since 6.2
+     **/
+    bool isInstrumentationEnabled() const;
+    /**
+     * @returns A snapshot of the statistics recorded for this EventQueue since the
+     * instrumentation got enabled or resetDispatchStatistics got invoked. The flush
+     * sizes are recorded by the ConnectionThread. This method may be invoked from any thread.
+     *
+     * @see setInstrumentationEnabled
+     * @since 6.2
+     **/
+    DispatchStatistics dispatchStatistics() const;
+    /**
+     * Clears all recorded statistics.
+     * @see dispatchStatistics
+     * @since 6.2
+     **/
+    void resetDispatchStatistics();
+
     operator wl_event_queue *();
     operator wl_event_queue *() const;
 
@@ -125,6 +188,11 @@ public Q_SLOTS:
     void dispatch();
 
 private:
+    friend class ConnectionThread;
+    /**
+     * Wakes up the thread of this EventQueue for dispatching, invoked by the ConnectionThread.
+     **/
+    void wakeUp();
     class Private;
     QScopedPointer<Private> d;
 };
@@ -0,0 +1,129 @@
+/*
+    SPDX-FileCopyrightText: 2026 Lingmo OS Team
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+#ifndef WAYLAND_LAZYGLOBAL_H
+#define WAYLAND_LAZYGLOBAL_H
+
+#include <QPointer>
+
+#include "registry.h"
+
+namespace KWayland
+{
+namespace Client
+{
+/**
+ * @short Handle for a global which gets bound on first use.
+ *
+ * Binding a global creates a protocol object in the Wayland server and allocates the wrapper,
+ * even if the client only needs it on rare user actions. A LazyGlobal records the name and
+ * version of an announced global together with the create method of the Registry, and only
+ * invokes it once the wrapper is used for the first time:
+ *
+ * @code
+ * LazyGlobal<DpmsManager> dpms;
+ * connect(registry, &Registry::dpmsAnnounced, this, [this, registry](quint32 name, quint32 version) {
+ *     dpms = LazyGlobal(registry, &Registry::createDpmsManager, name, version, this);
+ * });
+ * // later on
+ * if (DpmsManager *manager = dpms.get()) {
+ *     // use the manager
+ * }
+ * @endcode
+ *
+ * If the global got removed, its name got reused for another interface, or the Registry or
+ * the parent got destroyed before the first use, get returns @c nullptr. Once created, the
+ * wrapper behaves like one returned by the create method directly.
+ *
+ * @see Registry
+ * @since 6.2
+ **/
+template<typename T>
+class LazyGlobal
+{
+public:
+    using Factory = T *(Registry::*)(quint32 name, quint32 version, QObject *parent);
+
+    LazyGlobal() = default;
+    /**
+     * Records the global @p name in @p version, which gets created through @p factory on
+     * @p registry with @p parent on first use. The global has to be announced at this point.
+     **/
+    LazyGlobal(Registry *registry, Factory factory, quint32 name, quint32 version, QObject *parent = nullptr)
+        : m_registry(registry)
+        , m_factory(factory)
+        , m_name(name)
+        , m_version(version)
+        , m_interface(registry ? registry->interfaceForName(name) : Registry::Interface::Unknown)
+        , m_parent(parent)
+        , m_hasParent(parent)
+    {
+    }
+
+    /**
+     * @returns The wrapper for the global, creating it on the first invocation.
+     * @c nullptr if the global is gone.
+     **/
+    T *get()
+    {
+        Registry *registry = m_registry.data();
+        if (m_created || !registry || !m_factory || !registry->isValid()) {
+            return m_object;
+        }
+        // the wrapper would leak without its parent
+        if (m_hasParent && !m_parent) {
+            return nullptr;
+        }
+        // names of removed globals may get reused for other interfaces
+        if (m_interface == Registry::Interface::Unknown || registry->interfaceForName(m_name) != m_interface) {
+            return nullptr;
+        }
+        m_created = true;
+        m_object = (registry->*m_factory)(m_name, m_version, m_parent);
+        return m_object;
+    }
+    T *operator->()
+    {
+        return get();
+    }
+    /**
+     * @returns Whether the wrapper got created already.
+     **/
+    bool isCreated() const
+    {
+        return m_created;
+    }
+    /**
+     * @returns Whether a global got recorded.
+     **/
+    bool isValid() const
+    {
+        return m_factory;
+    }
+    quint32 name() const
+    {
+        return m_name;
+    }
+    quint32 version() const
+    {
+        return m_version;
+    }
+
+private:
+    QPointer<Registry> m_registry;
+    Factory m_factory = nullptr;
+    quint32 m_name = 0;
+    quint32 m_version = 0;
+    Registry::Interface m_interface = Registry::Interface::Unknown;
+    QPointer<QObject> m_parent;
+    bool m_hasParent = false;
+    QPointer<T> m_object;
+    bool m_created = false;
+};
+
+}
+}
+
+#endif
@@ -8,6 +8,8 @@
 #include "output.h"
 #include "surface.h"
 #include "wayland_pointer_p.h"
+
+#include <QHash>
 // Wayland
 #include <wayland-lingmo-shell-client-protocol.h>
 
@@ -28,6 +30,7 @@ public:
     Private(LingmoShellSurface *q);
     ~Private();
     void setup(org_kde_lingmo_surface *surface);
+    void setParentSurface(Surface *surface);
 
     WaylandPointer<org_kde_lingmo_surface, org_kde_lingmo_surface_destroy> surface;
     QSize size;
@@ -41,11 +44,13 @@ private:
     static void autoHidingPanelShownCallback(void *data, org_kde_lingmo_surface *org_kde_lingmo_surface);
 
     LingmoShellSurface *q;
-    static QList<Private *> s_surfaces;
+    // indexed by the parent Surface, the key is kept as parentSurface becomes null once it got deleted
+    Surface *indexedSurface = nullptr;
+    static QHash<Surface *, Private *> s_surfaces;
     static const org_kde_lingmo_surface_listener s_listener;
 };
 
-QList<LingmoShellSurface::Private *> LingmoShellSurface::Private::s_surfaces;
+QHash<Surface *, LingmoShellSurface::Private *> LingmoShellSurface::Private::s_surfaces;
 
 LingmoShell::LingmoShell(QObject *parent)
     : QObject(parent)
@@ -110,7 +115,7 @@ LingmoShellSurface *LingmoShell::createSurface(wl_surface *surface, QObject *par
         d->queue->addProxy(w);
     }
     s->setup(w);
-    s->d->parentSurface = QPointer<Surface>(kwS);
+    s->d->setParentSurface(kwS);
     return s;
 }
 
@@ -138,12 +143,23 @@ LingmoShellSurface::Private::Private(LingmoShellSurface *q)
     : role(LingmoShellSurface::Role::Normal)
     , q(q)
 {
-    s_surfaces << this;
 }
 
 LingmoShellSurface::Private::~Private()
 {
-    s_surfaces.removeAll(this);
+    auto it = s_surfaces.find(indexedSurface);
+    if (it != s_surfaces.end() && *it == this) {
+        s_surfaces.erase(it);
+    }
+}
+
+void LingmoShellSurface::Private::setParentSurface(Surface *surface)
+{
+    parentSurface = QPointer<Surface>(surface);
+    if (surface) {
+        indexedSurface = surface;
+        s_surfaces.insert(surface, this);
+    }
 }
 
 LingmoShellSurface *LingmoShellSurface::Private::get(Surface *surface)
@@ -151,10 +167,10 @@ LingmoShellSurface *LingmoShellSurface::Private::get(Surface *surface)
     if (!surface) {
         return nullptr;
     }
-    for (auto it = s_surfaces.constBegin(); it != s_surfaces.constEnd(); ++it) {
-        if ((*it)->parentSurface == surface) {
-            return (*it)->q;
-        }
+    Private *p = s_surfaces.value(surface);
+    // a new Surface might have been created at the address of a deleted parentSurface
+    if (p && p->parentSurface == surface) {
+        return p->q;
     }
     return nullptr;
 }
@@ -6,6 +6,7 @@
 #include "output.h"
 #include "wayland_pointer_p.h"
 // Qt
+#include <QHash>
 #include <QList>
 #include <QPoint>
 #include <QRect>
@@ -25,7 +26,6 @@ class Q_DECL_HIDDEN Output::Private
 {
 public:
     Private(Output *q);
-    ~Private();
     void setup(wl_output *o);
 
     WaylandPointer<wl_output, wl_output_release> output;
@@ -43,6 +43,12 @@ public:
     QString description;
 
     static Output *get(wl_output *o);
+    /**
+     * Removes the native output from s_outputs, unless it got reused by another Output.
+     **/
+    void removeFromIndex();
+    // looked up on every enter event, so indexed by the native output
+    static QHash<wl_output *, Output *> s_outputs;
 
 private:
     static void geometryCallback(void *data,
@@ -71,33 +77,18 @@ private:
 
     Output *q;
     static struct wl_output_listener s_outputListener;
-
-    static QList<Private *> s_allOutputs;
 };
 
-QList<Output::Private *> Output::Private::s_allOutputs;
+QHash<wl_output *, Output *> Output::Private::s_outputs;
 
 Output::Private::Private(Output *q)
     : q(q)
 {
-    s_allOutputs << this;
-}
-
-Output::Private::~Private()
-{
-    s_allOutputs.removeOne(this);
 }
 
 Output *Output::Private::get(wl_output *o)
 {
-    auto it = std::find_if(s_allOutputs.constBegin(), s_allOutputs.constEnd(), [o](Private *p) {
-        const wl_output *reference = p->output;
-        return reference == o;
-    });
-    if (it != s_allOutputs.constEnd()) {
-        return (*it)->q;
-    }
-    return nullptr;
+    return s_outputs.value(o);
 }
 
 void Output::Private::setup(wl_output *o)
@@ -105,9 +96,18 @@ void Output::Private::setup(wl_output *o)
     Q_ASSERT(o);
     Q_ASSERT(!output);
     output.setup(o);
+    s_outputs.insert(o, q);
     wl_output_add_listener(output, &s_outputListener, this);
 }
 
+void Output::Private::removeFromIndex()
+{
+    auto it = s_outputs.find(output);
+    if (it != s_outputs.end() && *it == q) {
+        s_outputs.erase(it);
+    }
+}
+
 bool Output::Mode::operator==(const Output::Mode &m) const
 {
     return size == m.size && refreshRate == m.refreshRate && flags == m.flags && output == m.output;
@@ -121,6 +121,7 @@ Output::Output(QObject *parent)
 
 Output::~Output()
 {
+    d->removeFromIndex();
     d->output.release();
 }
 
@@ -418,6 +419,7 @@ Output *Output::get(wl_output *o)
 
 void Output::destroy()
 {
+    d->removeFromIndex();
     d->output.destroy();
 }
 
@@ -0,0 +1,323 @@
+/*
+    SPDX-FileCopyrightText: 2026 Lingmo OS Team
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+#include "pixelconversion_p.h"
+// Qt
+#include <QRgb>
+// system
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#define KWAYLAND_HAVE_X86_KERNELS 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define KWAYLAND_HAVE_NEON_KERNELS 1
+#endif
+
+namespace KWayland
+{
+namespace Client
+{
+std::optional<Buffer::Format> bufferFormat(QImage::Format format)
+{
+    switch (format) {
+    case QImage::Format_ARGB32_Premultiplied:
+        return Buffer::Format::ARGB32;
+    case QImage::Format_RGB32:
+        return Buffer::Format::RGB32;
+    case QImage::Format_RGB16:
+        return Buffer::Format::RGB565;
+    case QImage::Format_RGBA8888_Premultiplied:
+        return Buffer::Format::ABGR32;
+    case QImage::Format_RGBX8888:
+        return Buffer::Format::XBGR32;
+    case QImage::Format_A2RGB30_Premultiplied:
+        return Buffer::Format::ARGB2101010;
+    default:
+        return std::nullopt;
+    }
+}
+
+QImage::Format imageFormat(Buffer::Format format)
+{
+    switch (format) {
+    case Buffer::Format::ARGB32:
+        return QImage::Format_ARGB32_Premultiplied;
+    case Buffer::Format::RGB32:
+        return QImage::Format_RGB32;
+    case Buffer::Format::RGB565:
+        return QImage::Format_RGB16;
+    case Buffer::Format::ABGR32:
+        return QImage::Format_RGBA8888_Premultiplied;
+    case Buffer::Format::XBGR32:
+        return QImage::Format_RGBX8888;
+    case Buffer::Format::ARGB2101010:
+        return QImage::Format_A2RGB30_Premultiplied;
+    }
+    return QImage::Format_Invalid;
+}
+
+int bytesPerPixel(Buffer::Format format)
+{
+    switch (format) {
+    case Buffer::Format::RGB565:
+        return 2;
+    case Buffer::Format::ARGB32:
+    case Buffer::Format::RGB32:
+    case Buffer::Format::ABGR32:
+    case Buffer::Format::XBGR32:
+    case Buffer::Format::ARGB2101010:
+        return 4;
+    }
+    return 4;
+}
+
+int32_t bufferStride(int width, Buffer::Format format)
+{
+    return (width * bytesPerPixel(format) + 3) & ~3;
+}
+
+std::optional<PixelConversion> pixelConversion(QImage::Format format, Buffer::Format targetFormat)
+{
+    if (bufferFormat(format) == targetFormat) {
+        return PixelConversion::None;
+    }
+    switch (targetFormat) {
+    case Buffer::Format::ARGB32:
+        switch (format) {
+        case QImage::Format_ARGB32:
+            return PixelConversion::Premultiply;
+        case QImage::Format_RGBA8888_Premultiplied:
+            return PixelConversion::Swizzle;
+        case QImage::Format_RGBA8888:
+            return PixelConversion::SwizzlePremultiply;
+        default:
+            return std::nullopt;
+        }
+    case Buffer::Format::RGB32:
+        switch (format) {
+        case QImage::Format_RGBX8888:
+            return PixelConversion::Swizzle;
+        default:
+            return std::nullopt;
+        }
+    default:
+        return std::nullopt;
+    }
+}
+
+namespace
+{
+// in memory ARGB32 is B, G, R, A while RGBA8888 is R, G, B, A
+inline quint32 swizzle(quint32 p)
+{
+    return (p & 0xff00ff00) | ((p >> 16) & 0xff) | ((p & 0xff) << 16);
+}
+
+void premultiplyGeneric(uchar *dst, const uchar *src, int count)
+{
+    auto d = reinterpret_cast<quint32 *>(dst);
+    auto s = reinterpret_cast<const quint32 *>(src);
+    for (int i = 0; i < count; ++i) {
+        d[i] = qPremultiply(s[i]);
+    }
+}
+
+void swizzleGeneric(uchar *dst, const uchar *src, int count)
+{
+    auto d = reinterpret_cast<quint32 *>(dst);
+    auto s = reinterpret_cast<const quint32 *>(src);
+    for (int i = 0; i < count; ++i) {
+        d[i] = swizzle(s[i]);
+    }
+}
+
+void swizzlePremultiplyGeneric(uchar *dst, const uchar *src, int count)
+{
+    auto d = reinterpret_cast<quint32 *>(dst);
+    auto s = reinterpret_cast<const quint32 *>(src);
+    for (int i = 0; i < count; ++i) {
+        d[i] = qPremultiply(swizzle(s[i]));
+    }
+}
+
+#if KWAYLAND_HAVE_X86_KERNELS
+// Multiplies the color channels of four pixels with their alpha using the same
+// rounding as qPremultiply: (t + (t >> 8) + 0x80) >> 8
+inline __m128i premultiply4(__m128i pixels)
+{
+    const __m128i zero = _mm_setzero_si128();
+    // keep alpha by multiplying it with 255
+    const __m128i colorMask = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+    const __m128i alphaLane = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+    const __m128i half = _mm_set1_epi16(0x80);
+    auto multiply = [&](__m128i channels) {
+        __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(channels, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+        alpha = _mm_or_si128(_mm_and_si128(alpha, colorMask), alphaLane);
+        __m128i t = _mm_mullo_epi16(channels, alpha);
+        t = _mm_add_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), half);
+        return _mm_srli_epi16(t, 8);
+    };
+    const __m128i low = multiply(_mm_unpacklo_epi8(pixels, zero));
+    const __m128i high = multiply(_mm_unpackhi_epi8(pixels, zero));
+    return _mm_packus_epi16(low, high);
+}
+
+inline __m128i swizzle4(__m128i pixels)
+{
+    const __m128i keep = _mm_set1_epi32(0xff00ff00);
+    const __m128i low = _mm_set1_epi32(0xff);
+    return _mm_or_si128(_mm_or_si128(_mm_and_si128(pixels, keep), _mm_and_si128(_mm_srli_epi32(pixels, 16), low)),
+                        _mm_slli_epi32(_mm_and_si128(pixels, low), 16));
+}
+
+template<bool doSwizzle, bool doPremultiply>
+void convertSse2(uchar *dst, const uchar *src, int count)
+{
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 4));
+        if constexpr (doSwizzle) {
+            pixels = swizzle4(pixels);
+        }
+        if constexpr (doPremultiply) {
+            pixels = premultiply4(pixels);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4), pixels);
+    }
+    if constexpr (doSwizzle && doPremultiply) {
+        swizzlePremultiplyGeneric(dst + i * 4, src + i * 4, count - i);
+    } else if constexpr (doSwizzle) {
+        swizzleGeneric(dst + i * 4, src + i * 4, count - i);
+    } else {
+        premultiplyGeneric(dst + i * 4, src + i * 4, count - i);
+    }
+}
+
+__attribute__((target("avx2"))) inline __m256i premultiply8(__m256i pixels)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i colorMask = _mm256_set_epi16(0, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1);
+    const __m256i alphaLane = _mm256_set_epi16(255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0);
+    const __m256i half = _mm256_set1_epi16(0x80);
+    // unpack and pack work within 128 bit lanes, so the pixel order is preserved
+    __m256i low = _mm256_unpacklo_epi8(pixels, zero);
+    __m256i high = _mm256_unpackhi_epi8(pixels, zero);
+    __m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(low, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    alpha = _mm256_or_si256(_mm256_and_si256(alpha, colorMask), alphaLane);
+    low = _mm256_mullo_epi16(low, alpha);
+    low = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(low, _mm256_srli_epi16(low, 8)), half), 8);
+    alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(high, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    alpha = _mm256_or_si256(_mm256_and_si256(alpha, colorMask), alphaLane);
+    high = _mm256_mullo_epi16(high, alpha);
+    high = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(high, _mm256_srli_epi16(high, 8)), half), 8);
+    return _mm256_packus_epi16(low, high);
+}
+
+__attribute__((target("avx2"))) inline __m256i swizzle8(__m256i pixels)
+{
+    const __m256i swap = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15, //
+                                          2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    return _mm256_shuffle_epi8(pixels, swap);
+}
+
+template<bool doSwizzle, bool doPremultiply>
+__attribute__((target("avx2"))) void convertAvx2(uchar *dst, const uchar *src, int count)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i * 4));
+        if constexpr (doSwizzle) {
+            pixels = swizzle8(pixels);
+        }
+        if constexpr (doPremultiply) {
+            pixels = premultiply8(pixels);
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i * 4), pixels);
+    }
+    convertSse2<doSwizzle, doPremultiply>(dst + i * 4, src + i * 4, count - i);
+}
+#endif
+
+#if KWAYLAND_HAVE_NEON_KERNELS
+// same rounding as qPremultiply: (t + (t >> 8) + 0x80) >> 8
+inline uint8x8_t multiplyNeon(uint8x8_t channel, uint8x8_t alpha)
+{
+    const uint16x8_t t = vmull_u8(channel, alpha);
+    return vshrn_n_u16(vaddq_u16(vaddq_u16(t, vshrq_n_u16(t, 8)), vdupq_n_u16(0x80)), 8);
+}
+
+template<bool doSwizzle, bool doPremultiply>
+void convertNeon(uchar *dst, const uchar *src, int count)
+{
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        uint8x8x4_t pixels = vld4_u8(src + i * 4);
+        if constexpr (doSwizzle) {
+            const uint8x8_t red = pixels.val[0];
+            pixels.val[0] = pixels.val[2];
+            pixels.val[2] = red;
+        }
+        if constexpr (doPremultiply) {
+            pixels.val[0] = multiplyNeon(pixels.val[0], pixels.val[3]);
+            pixels.val[1] = multiplyNeon(pixels.val[1], pixels.val[3]);
+            pixels.val[2] = multiplyNeon(pixels.val[2], pixels.val[3]);
+        }
+        vst4_u8(dst + i * 4, pixels);
+    }
+    if constexpr (doSwizzle && doPremultiply) {
+        swizzlePremultiplyGeneric(dst + i * 4, src + i * 4, count - i);
+    } else if constexpr (doSwizzle) {
+        swizzleGeneric(dst + i * 4, src + i * 4, count - i);
+    } else {
+        premultiplyGeneric(dst + i * 4, src + i * 4, count - i);
+    }
+}
+#endif
+
+typedef void (*ConvertFunction)(uchar *dst, const uchar *src, int count);
+
+struct Kernels {
+    ConvertFunction premultiply;
+    ConvertFunction swizzle;
+    ConvertFunction swizzlePremultiply;
+};
+
+Kernels selectKernels()
+{
+#if KWAYLAND_HAVE_X86_KERNELS
+    if (__builtin_cpu_supports("avx2")) {
+        return {convertAvx2<false, true>, convertAvx2<true, false>, convertAvx2<true, true>};
+    }
+    return {convertSse2<false, true>, convertSse2<true, false>, convertSse2<true, true>};
+#elif KWAYLAND_HAVE_NEON_KERNELS
+    return {convertNeon<false, true>, convertNeon<true, false>, convertNeon<true, true>};
+#endif
+    return {premultiplyGeneric, swizzleGeneric, swizzlePremultiplyGeneric};
+}
+}
+
+void convertPixels(PixelConversion conversion, uchar *dst, const uchar *src, int pixelCount)
+{
+    static const Kernels s_kernels = selectKernels();
+    switch (conversion) {
+    case PixelConversion::None:
+        memcpy(dst, src, pixelCount * 4);
+        break;
+    case PixelConversion::Premultiply:
+        s_kernels.premultiply(dst, src, pixelCount);
+        break;
+    case PixelConversion::Swizzle:
+        s_kernels.swizzle(dst, src, pixelCount);
+        break;
+    case PixelConversion::SwizzlePremultiply:
+        s_kernels.swizzlePremultiply(dst, src, pixelCount);
+        break;
+    }
+}
+
+}
+}
@@ -0,0 +1,67 @@
+/*
+    SPDX-FileCopyrightText: 2026 Lingmo OS Team
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+#ifndef WAYLAND_PIXELCONVERSION_P_H
+#define WAYLAND_PIXELCONVERSION_P_H
+
+#include "buffer.h"
+
+#include <QImage>
+
+#include <optional>
+
+namespace KWayland
+{
+namespace Client
+{
+/**
+ * @returns The Buffer::Format sharing the memory layout of @p format, if there is one.
+ **/
+std::optional<Buffer::Format> bufferFormat(QImage::Format format);
+
+/**
+ * @returns The QImage::Format sharing the memory layout of @p format.
+ **/
+QImage::Format imageFormat(Buffer::Format format);
+
+/**
+ * @returns The number of bytes a pixel of @p format occupies.
+ **/
+int bytesPerPixel(Buffer::Format format);
+
+/**
+ * @returns The stride of a Buffer holding @p width pixels of @p format. Like the scanlines of
+ * a QImage, the scanlines are aligned to 4 bytes.
+ **/
+int32_t bufferStride(int width, Buffer::Format format);
+
+/**
+ * Conversions which can be applied while copying pixels of a QImage into a Buffer.
+ * All of them except None operate on 32 bit pixels.
+ **/
+enum class PixelConversion {
+    None, ///< plain copy
+    Premultiply, ///< QImage::Format_ARGB32 to Buffer::Format::ARGB32
+    Swizzle, ///< swap red and blue, e.g. QImage::Format_RGBA8888_Premultiplied to Buffer::Format::ARGB32
+    SwizzlePremultiply, ///< QImage::Format_RGBA8888 to Buffer::Format::ARGB32
+};
+
+/**
+ * @returns The conversion needed to copy pixels of @p format into a Buffer of @p targetFormat
+ * or @c nullopt if there is no direct conversion and the image needs to be converted with
+ * QImage::convertToFormat first.
+ **/
+std::optional<PixelConversion> pixelConversion(QImage::Format format, Buffer::Format targetFormat);
+
+/**
+ * Converts @p pixelCount pixels from @p src into @p dst applying @p conversion.
+ * Uses the fastest implementation the CPU supports.
+ **/
+void convertPixels(PixelConversion conversion, uchar *dst, const uchar *src, int pixelCount);
+
+}
+}
+
+#endif
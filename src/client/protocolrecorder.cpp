@@ -0,0 +1,398 @@
+/*
+    SPDX-FileCopyrightText: 2026 Lingmo OS Team
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+#include "protocolrecorder_p.h"
+#include "logging.h"
+// Qt
+#include <QFile>
+#include <QThread>
+// system
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace KWayland
+{
+namespace Client
+{
+namespace
+{
+// libwayland never passes more file descriptors with a single message
+static const int s_maxFds = 28;
+// data received but not yet forwarded, beyond this the source is not read anymore
+static const qsizetype s_maxQueued = 1024 * 1024;
+
+static bool setNonBlocking(int fd)
+{
+    const int flags = fcntl(fd, F_GETFL);
+    return flags != -1 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) != -1;
+}
+
+static uint64_t clockNanoseconds(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+}
+
+ProtocolRecorder::~ProtocolRecorder()
+{
+    stop();
+}
+
+int ProtocolRecorder::start(int fd, const QString &fileName, qint64 capacity)
+{
+    serverFd = fd;
+    // neither direction may block the other one, see run
+    if (!setNonBlocking(serverFd)) {
+        qCWarning(KWAYLAND_CLIENT) << "Could not set up the Wayland socket for recording:" << strerror(errno);
+        stop();
+        return -1;
+    }
+    if (!openTrace(fileName, capacity)) {
+        stop();
+        return -1;
+    }
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == -1) {
+        qCWarning(KWAYLAND_CLIENT) << "Could not create socket pair for recording:" << strerror(errno);
+        stop();
+        return -1;
+    }
+    clientFd = fds[0];
+    if (!setNonBlocking(clientFd)) {
+        qCWarning(KWAYLAND_CLIENT) << "Could not create socket pair for recording:" << strerror(errno);
+        close(fds[1]);
+        stop();
+        return -1;
+    }
+    wakeupFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (wakeupFd == -1) {
+        qCWarning(KWAYLAND_CLIENT) << "Could not create eventfd for recording:" << strerror(errno);
+        close(fds[1]);
+        stop();
+        return -1;
+    }
+    thread = QThread::create([this] {
+        run();
+    });
+    thread->setObjectName(QStringLiteral("KWaylandRecorder"));
+    thread->start();
+    return fds[1];
+}
+
+void ProtocolRecorder::stop()
+{
+    if (thread) {
+        const uint64_t value = 1;
+        if (write(wakeupFd, &value, sizeof(value)) < 0) {
+            qCWarning(KWAYLAND_CLIENT) << "Could not wake up the recording thread";
+        }
+        thread->wait();
+        delete thread;
+        thread = nullptr;
+    }
+    for (int *fd : {&serverFd, &clientFd, &wakeupFd}) {
+        if (*fd != -1) {
+            close(*fd);
+            *fd = -1;
+        }
+    }
+    if (header) {
+        msync(header, mappedSize, MS_ASYNC);
+        munmap(header, mappedSize);
+        header = nullptr;
+        ring = nullptr;
+    }
+}
+
+bool ProtocolRecorder::openTrace(const QString &fileName, qint64 capacity)
+{
+    capacity = ProtocolTrace::alignedLength(qMax<qint64>(capacity, 4096));
+    const int fd = open(QFile::encodeName(fileName).constData(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        qCWarning(KWAYLAND_CLIENT) << "Could not open protocol trace" << fileName << strerror(errno);
+        return false;
+    }
+    mappedSize = sizeof(ProtocolTrace::FileHeader) + capacity;
+    if (ftruncate(fd, mappedSize) == -1) {
+        qCWarning(KWAYLAND_CLIENT) << "Could not set size of protocol trace" << fileName << strerror(errno);
+        close(fd);
+        return false;
+    }
+    void *data = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    // the mapping keeps the file alive
+    close(fd);
+    if (data == MAP_FAILED) {
+        qCWarning(KWAYLAND_CLIENT) << "Could not map protocol trace" << fileName << strerror(errno);
+        return false;
+    }
+    header = static_cast<ProtocolTrace::FileHeader *>(data);
+    ring = static_cast<char *>(data) + sizeof(ProtocolTrace::FileHeader);
+    memcpy(header->magic, ProtocolTrace::s_magic, sizeof(header->magic));
+    header->version = ProtocolTrace::s_version;
+    header->headerSize = sizeof(ProtocolTrace::FileHeader);
+    header->capacity = capacity;
+    header->startTime = clockNanoseconds(CLOCK_REALTIME);
+    startTime = clockNanoseconds(CLOCK_MONOTONIC);
+    return true;
+}
+
+void ProtocolRecorder::run()
+{
+    // each direction queues what its destination cannot take yet, so that a client busy with
+    // a burst of events still gets its requests forwarded and the other way round
+    Stream events{ProtocolTrace::Direction::Event, serverFd, clientFd};
+    Stream requests{ProtocolTrace::Direction::Request, clientFd, serverFd};
+    Stream *streams[] = {&events, &requests};
+    struct pollfd pfds[5];
+    bool running = true;
+    while (running) {
+        // from, to of events, from, to of requests and the wakeupFd
+        for (int i = 0; i < 2; ++i) {
+            const Stream &stream = *streams[i];
+            pfds[2 * i].fd = stream.from;
+            pfds[2 * i].events = !stream.closed && stream.queuedBytes < s_maxQueued ? POLLIN : 0;
+            pfds[2 * i + 1].fd = stream.to;
+            pfds[2 * i + 1].events = stream.outgoing.isEmpty() ? 0 : POLLOUT;
+        }
+        pfds[4].fd = wakeupFd;
+        pfds[4].events = POLLIN;
+        if (poll(pfds, 5, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (pfds[4].revents) {
+            break;
+        }
+        for (int i = 0; i < 2 && running; ++i) {
+            Stream &stream = *streams[i];
+            if (pfds[2 * i].events && pfds[2 * i].revents && !receive(stream)) {
+                stream.closed = true;
+            }
+            if (!stream.outgoing.isEmpty() && !send(stream)) {
+                running = false;
+            } else if (stream.closed && stream.outgoing.isEmpty()) {
+                // the peer went away, let the other end notice once it got everything
+                shutdown(stream.to, SHUT_RDWR);
+                running = false;
+            }
+        }
+    }
+    for (Stream *stream : streams) {
+        for (const Stream::Chunk &chunk : std::as_const(stream->outgoing)) {
+            for (int fd : chunk.fds) {
+                close(fd);
+            }
+        }
+    }
+}
+
+bool ProtocolRecorder::receive(Stream &stream)
+{
+    char buffer[4096];
+    char control[CMSG_SPACE(sizeof(int) * s_maxFds)];
+    struct iovec iov;
+    iov.iov_base = buffer;
+    iov.iov_len = sizeof(buffer);
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t received;
+    do {
+        received = recvmsg(stream.from, &msg, MSG_CMSG_CLOEXEC);
+    } while (received == -1 && errno == EINTR);
+    if (received <= 0) {
+        return received == -1 && errno == EAGAIN;
+    }
+
+    Stream::Chunk chunk;
+    chunk.data = QByteArray(buffer, received);
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        const int count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        const int *fds = reinterpret_cast<const int *>(CMSG_DATA(cmsg));
+        for (int i = 0; i < count; ++i) {
+            chunk.fds.append(fds[i]);
+        }
+    }
+    if (msg.msg_flags & MSG_CTRUNC) {
+        // the file descriptors which did not fit are gone, forwarding would get both ends out of sync
+        qCWarning(KWAYLAND_CLIENT) << "Dropped file descriptors while recording, stopping to forward";
+        for (int fd : std::as_const(chunk.fds)) {
+            close(fd);
+        }
+        return false;
+    }
+
+    stream.pending.append(chunk.data);
+    stream.pendingFds += chunk.fds.size();
+    parse(stream);
+    stream.queuedBytes += chunk.data.size();
+    stream.outgoing.append(std::move(chunk));
+    return true;
+}
+
+bool ProtocolRecorder::send(Stream &stream)
+{
+    while (!stream.outgoing.isEmpty()) {
+        Stream::Chunk &chunk = stream.outgoing.first();
+        // forward the data unchanged, the file descriptors go along with the first part of it
+        struct iovec iov;
+        iov.iov_base = chunk.data.data() + chunk.sent;
+        iov.iov_len = chunk.data.size() - chunk.sent;
+        struct msghdr out = {};
+        out.msg_iov = &iov;
+        out.msg_iovlen = 1;
+        char control[CMSG_SPACE(sizeof(int) * s_maxFds)];
+        if (!chunk.fds.isEmpty()) {
+            out.msg_control = control;
+            out.msg_controllen = CMSG_SPACE(sizeof(int) * chunk.fds.size());
+            struct cmsghdr *cmsg = CMSG_FIRSTHDR(&out);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(int) * chunk.fds.size());
+            memcpy(CMSG_DATA(cmsg), chunk.fds.constData(), sizeof(int) * chunk.fds.size());
+        }
+        ssize_t sent;
+        do {
+            sent = sendmsg(stream.to, &out, MSG_NOSIGNAL | MSG_DONTWAIT);
+        } while (sent == -1 && errno == EINTR);
+        if (sent == -1) {
+            return errno == EAGAIN;
+        }
+        for (int fd : std::as_const(chunk.fds)) {
+            close(fd);
+        }
+        chunk.fds.clear();
+        chunk.sent += sent;
+        stream.queuedBytes -= sent;
+        if (chunk.sent < chunk.data.size()) {
+            // the socket is full, continue on POLLOUT
+            return true;
+        }
+        stream.outgoing.removeFirst();
+    }
+    return true;
+}
+
+void ProtocolRecorder::parse(Stream &stream)
+{
+    // each message starts with the object id and a word holding its size and opcode
+    int offset = 0;
+    while (stream.pending.size() - offset >= 8) {
+        uint32_t words[2];
+        memcpy(words, stream.pending.constData() + offset, sizeof(words));
+        const uint32_t size = words[1] >> 16;
+        if (size < 8) {
+            // not a valid message, libwayland is going to fail on it as well
+            stream.pending.clear();
+            return;
+        }
+        if (uint32_t(stream.pending.size() - offset) < size) {
+            break;
+        }
+        // file descriptors are not bound to a message on the socket, attribute them to the next one
+        record(stream.direction, words[0], words[1] & 0xffff, stream.pending.constData() + offset + 8, size - 8, stream.pendingFds);
+        stream.pendingFds = 0;
+        offset += size;
+    }
+    stream.pending.remove(0, offset);
+}
+
+void ProtocolRecorder::dropOldest()
+{
+    using namespace ProtocolTrace;
+    // the end of the ring buffer is skipped if it is too small for a Record or padded
+    const uint64_t toEnd = header->capacity - header->tail;
+    uint64_t length = toEnd;
+    if (toEnd >= sizeof(Record)) {
+        const Record *oldest = reinterpret_cast<const Record *>(ring + header->tail);
+        if (oldest->direction != Direction::Padding) {
+            length = oldest->length;
+            ++header->droppedCount;
+        }
+    }
+    header->used -= length;
+    header->tail += length;
+    if (header->tail == header->capacity) {
+        header->tail = 0;
+    }
+}
+
+uint64_t ProtocolRecorder::contiguousFree() const
+{
+    if (header->used == 0) {
+        return header->capacity - header->head;
+    }
+    if (header->tail > header->head) {
+        return header->tail - header->head;
+    }
+    if (header->tail < header->head) {
+        return header->capacity - header->head;
+    }
+    return 0;
+}
+
+void ProtocolRecorder::record(ProtocolTrace::Direction direction, uint32_t objectId, uint16_t opcode, const char *arguments, uint16_t size, int fdCount)
+{
+    using namespace ProtocolTrace;
+    const uint32_t payload = qMin<uint32_t>(size, s_maxPayload);
+    const uint32_t length = alignedLength(sizeof(Record) + payload);
+    if (header->used == 0) {
+        header->head = header->tail = 0;
+    }
+    const uint64_t toEnd = header->capacity - header->head;
+    if (toEnd < length) {
+        // Records never wrap, so fill up the end and continue at the start
+        while (contiguousFree() < toEnd) {
+            dropOldest();
+        }
+        if (toEnd >= sizeof(Record)) {
+            Record *padding = reinterpret_cast<Record *>(ring + header->head);
+            memset(padding, 0, sizeof(Record));
+            padding->length = toEnd;
+            padding->direction = Direction::Padding;
+        }
+        header->used += toEnd;
+        header->head = 0;
+    }
+    while (contiguousFree() < length) {
+        dropOldest();
+    }
+
+    Record *r = reinterpret_cast<Record *>(ring + header->head);
+    r->length = length;
+    r->objectId = objectId;
+    r->timestamp = clockNanoseconds(CLOCK_MONOTONIC) - startTime;
+    r->opcode = opcode;
+    r->direction = direction;
+    r->fdCount = qMin(fdCount, 255);
+    r->size = size;
+    r->reserved = 0;
+    memcpy(ring + header->head + sizeof(Record), arguments, payload);
+    header->head += length;
+    if (header->head == header->capacity) {
+        header->head = 0;
+    }
+    header->used += length;
+    ++header->recordCount;
+}
+
+}
+}
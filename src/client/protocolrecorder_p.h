@@ -0,0 +1,107 @@
+/*
+    SPDX-FileCopyrightText: 2026 Lingmo OS Team
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+#ifndef WAYLAND_PROTOCOLRECORDER_P_H
+#define WAYLAND_PROTOCOLRECORDER_P_H
+
+#include "protocoltrace_p.h"
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+
+class QThread;
+
+namespace KWayland
+{
+namespace Client
+{
+/**
+ * Records the Wayland protocol traffic of a connection into a trace file.
+ *
+ * libwayland-client offers no way to observe the messages, so the ProtocolRecorder sits
+ * between the Wayland server and libwayland: a worker thread forwards all data and file
+ * descriptors between the socket of the server and a socket pair whose other end is handed
+ * to wl_display_connect_to_fd, while splitting the stream into messages and recording them.
+ *
+ * @see ProtocolTrace
+ **/
+class Q_DECL_HIDDEN ProtocolRecorder
+{
+public:
+    ProtocolRecorder() = default;
+    ProtocolRecorder(const ProtocolRecorder &) = delete;
+    ~ProtocolRecorder();
+
+    /**
+     * Starts forwarding the traffic of @p serverFd and recording it into @p fileName with a
+     * ring buffer of @p capacity bytes. Takes ownership of @p serverFd.
+     * @returns The file descriptor to connect libwayland to, @c -1 on failure.
+     **/
+    int start(int serverFd, const QString &fileName, qint64 capacity);
+    /**
+     * Stops forwarding and closes the trace file.
+     **/
+    void stop();
+
+private:
+    struct Stream {
+        ProtocolTrace::Direction direction;
+        int from;
+        int to;
+        // received data not yet forming a complete message
+        QByteArray pending;
+        // file descriptors received but not yet attributed to a message
+        int pendingFds = 0;
+        // data as received together with its file descriptors
+        struct Chunk {
+            QByteArray data;
+            QList<int> fds;
+            qsizetype sent = 0;
+        };
+        // received but not yet forwarded
+        QList<Chunk> outgoing;
+        qsizetype queuedBytes = 0;
+        // the source got closed or failed
+        bool closed = false;
+    };
+    void run();
+    /**
+     * Receives and records the data available on @p stream, queuing it for forwarding.
+     * @returns @c false once the source of the stream got closed or failed.
+     **/
+    bool receive(Stream &stream);
+    /**
+     * Forwards as much of the queued data of @p stream as its destination takes.
+     * @returns @c false if the destination failed.
+     **/
+    bool send(Stream &stream);
+    void parse(Stream &stream);
+    /**
+     * Frees the oldest Record in the ring buffer.
+     **/
+    void dropOldest();
+    /**
+     * @returns The free bytes in the ring buffer starting at the head.
+     **/
+    uint64_t contiguousFree() const;
+    void record(ProtocolTrace::Direction direction, uint32_t objectId, uint16_t opcode, const char *arguments, uint16_t size, int fdCount);
+    bool openTrace(const QString &fileName, qint64 capacity);
+
+    QThread *thread = nullptr;
+    int serverFd = -1;
+    int clientFd = -1;
+    // eventfd to wake up the thread for stopping
+    int wakeupFd = -1;
+    ProtocolTrace::FileHeader *header = nullptr;
+    char *ring = nullptr;
+    size_t mappedSize = 0;
+    uint64_t startTime = 0;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,132 @@
+/*
+    SPDX-FileCopyrightText: 2026 Lingmo OS Team
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+#ifndef WAYLAND_PROTOCOLTRACE_P_H
+#define WAYLAND_PROTOCOLTRACE_P_H
+
+#include <cstdint>
+#include <cstring>
+
+namespace KWayland
+{
+namespace Client
+{
+/**
+ * Binary format of the protocol traces written by the ConnectionThread.
+ *
+ * A trace file consists of a FileHeader followed by a ring buffer of FileHeader::capacity
+ * bytes. The ring buffer holds Records, each followed by the first bytes of the arguments
+ * of the message. Records are aligned to s_alignment bytes and never wrap around the end
+ * of the ring buffer, instead a Record with Direction::Padding fills the remaining space.
+ * Once the ring buffer is full the oldest Records get overwritten.
+ *
+ * The trace file is shared with the writer while recording, so tail and head only
+ * describe a consistent state once the recording ended.
+ **/
+namespace ProtocolTrace
+{
+static const char s_magic[8] = {'K', 'W', 'L', 'T', 'R', 'A', 'C', 'E'};
+static const uint32_t s_version = 1;
+static const uint32_t s_alignment = 8;
+// arguments of a message beyond this amount of bytes are not recorded, covers the largest
+// message libwayland sends, which is 4096 bytes including the 8 bytes of the message header
+static const uint32_t s_maxPayload = 4088;
+
+enum class Direction : uint8_t {
+    Request = 0, ///< sent by the client
+    Event = 1, ///< sent by the Wayland server
+    Padding = 0xff, ///< fills the ring buffer up to its end
+};
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    // size of the ring buffer following the header
+    uint64_t capacity;
+    // offsets of the oldest Record and behind the newest Record in the ring buffer
+    uint64_t tail;
+    uint64_t head;
+    // bytes of the ring buffer used by Records
+    uint64_t used;
+    // wall clock time in nanoseconds since the epoch when the recording started
+    uint64_t startTime;
+    // number of Records written and overwritten
+    uint64_t recordCount;
+    uint64_t droppedCount;
+};
+
+struct Record {
+    // size of the Record including the recorded payload and alignment
+    uint32_t length;
+    uint32_t objectId;
+    // monotonic time in nanoseconds since the recording started
+    uint64_t timestamp;
+    uint16_t opcode;
+    Direction direction;
+    // number of file descriptors passed along with the message
+    uint8_t fdCount;
+    // size of the message's arguments, the first min(size, s_maxPayload) bytes follow the Record,
+    // older traces recorded less, see recordedPayload
+    uint16_t size;
+    uint16_t reserved;
+};
+
+static_assert(sizeof(FileHeader) == 72, "FileHeader must not contain padding");
+static_assert(sizeof(Record) == 24, "Record must not contain padding");
+
+inline uint32_t alignedLength(uint32_t length)
+{
+    return (length + s_alignment - 1) & ~(s_alignment - 1);
+}
+
+/**
+ * @returns The number of argument bytes following @p record. Derived from the length of the
+ * Record, as traces written with a smaller s_maxPayload share the format.
+ **/
+inline uint32_t recordedPayload(const Record &record)
+{
+    const uint32_t recorded = record.length - sizeof(Record);
+    return record.size < recorded ? record.size : recorded;
+}
+
+/**
+ * Invokes @p callback with each Record in the @p ring buffer described by @p header and a
+ * pointer to its payload, from the oldest to the newest one.
+ **/
+template<typename Callback>
+void forEachRecord(const FileHeader &header, const char *ring, Callback callback)
+{
+    uint64_t position = header.tail;
+    uint64_t consumed = 0;
+    while (consumed < header.used) {
+        const uint64_t toEnd = header.capacity - position;
+        Record record;
+        if (toEnd >= sizeof(Record)) {
+            memcpy(&record, ring + position, sizeof(Record));
+        }
+        if (toEnd < sizeof(Record) || record.direction == Direction::Padding) {
+            consumed += toEnd;
+            position = 0;
+            continue;
+        }
+        if (record.length < sizeof(Record) || record.length > toEnd) {
+            // the trace got written while reading it
+            return;
+        }
+        callback(record, ring + position + sizeof(Record));
+        consumed += record.length;
+        position += record.length;
+        if (position == header.capacity) {
+            position = 0;
+        }
+    }
+}
+}
+
+}
+}
+
+#endif
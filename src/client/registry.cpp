@@ -38,6 +38,13 @@
 #include "xdgshell_p.h"
 // Qt
 #include <QDebug>
+#include <QHash>
+#include <QPointer>
+
+#include <algorithm>
+#include <array>
+#include <iterator>
+#include <string_view>
 // wayland
 #include "../compat/wayland-xdg-shell-v5-client-protocol.h"
 #include <wayland-appmenu-client-protocol.h>
@@ -70,7 +77,7 @@
  * * define the create<InterfaceName> method
  * * define the <interfaceName>Announced signal
  * * define the <interfaceName>Removed signal
- * * add a block to s_interfaces
+ * * add a block to s_interfaces, keeping the order of Registry::Interface
  * * add the BIND macro for the new bind<InterfaceName>
  * * add the CREATE macro for the new create<InterfaceName>
  * * extend registry unit test to verify that it works
@@ -83,241 +90,296 @@ namespace Client
 namespace
 {
 struct SuppertedInterfaceData {
+    Registry::Interface interface;
     quint32 maxVersion;
-    QByteArray name;
-    const wl_interface *interface;
+    std::string_view name;
+    const wl_interface *wlInterface;
     void (Registry::*announcedSignal)(quint32, quint32);
     void (Registry::*removedSignal)(quint32);
 };
+// indexed by Registry::Interface, so ordered like the enum
 // clang-format off
-static const QMap<Registry::Interface, SuppertedInterfaceData> s_interfaces = {
-    {Registry::Interface::Compositor, {
+static constexpr SuppertedInterfaceData s_interfaces[] = {
+    {Registry::Interface::Unknown, 0, {}, nullptr, nullptr, nullptr},
+    {Registry::Interface::Compositor,
         4,
-        QByteArrayLiteral("wl_compositor"),
+        "wl_compositor",
         &wl_compositor_interface,
         &Registry::compositorAnnounced,
         &Registry::compositorRemoved
-    }},
-    {Registry::Interface::DataDeviceManager, {
-        3,
-        QByteArrayLiteral("wl_data_device_manager"),
-        &wl_data_device_manager_interface,
-        &Registry::dataDeviceManagerAnnounced,
-        &Registry::dataDeviceManagerRemoved
-    }},
-    {Registry::Interface::Output, {
-        4,
-        QByteArrayLiteral("wl_output"),
-        &wl_output_interface,
-        &Registry::outputAnnounced,
-        &Registry::outputRemoved
-    }},
-    {Registry::Interface::Shm, {
+    },
+    {Registry::Interface::Shell,
         1,
-        QByteArrayLiteral("wl_shm"),
-        &wl_shm_interface,
-        &Registry::shmAnnounced,
-        &Registry::shmRemoved
-    }},
-    {Registry::Interface::Seat, {
+        "wl_shell",
+        &wl_shell_interface,
+        &Registry::shellAnnounced,
+        &Registry::shellRemoved
+    },
+    {Registry::Interface::Seat,
         5,
-        QByteArrayLiteral("wl_seat"),
+        "wl_seat",
         &wl_seat_interface,
         &Registry::seatAnnounced,
         &Registry::seatRemoved
-    }},
-    {Registry::Interface::Shell, {
+    },
+    {Registry::Interface::Shm,
         1,
-        QByteArrayLiteral("wl_shell"),
-        &wl_shell_interface,
-        &Registry::shellAnnounced,
-        &Registry::shellRemoved
-    }},
-    {Registry::Interface::SubCompositor, {
+        "wl_shm",
+        &wl_shm_interface,
+        &Registry::shmAnnounced,
+        &Registry::shmRemoved
+    },
+    {Registry::Interface::Output,
+        4,
+        "wl_output",
+        &wl_output_interface,
+        &Registry::outputAnnounced,
+        &Registry::outputRemoved
+    },
+    {Registry::Interface::SubCompositor,
         1,
-        QByteArrayLiteral("wl_subcompositor"),
+        "wl_subcompositor",
         &wl_subcompositor_interface,
         &Registry::subCompositorAnnounced,
         &Registry::subCompositorRemoved
-    }},
-    {Registry::Interface::LingmoShell, {
+    },
+    {Registry::Interface::DataDeviceManager,
+        3,
+        "wl_data_device_manager",
+        &wl_data_device_manager_interface,
+        &Registry::dataDeviceManagerAnnounced,
+        &Registry::dataDeviceManagerRemoved
+    },
+    {Registry::Interface::LingmoShell,
         8,
-        QByteArrayLiteral("org_kde_lingmo_shell"),
+        "org_kde_lingmo_shell",
         &org_kde_lingmo_shell_interface,
         &Registry::lingmoShellAnnounced,
         &Registry::lingmoShellRemoved
-    }},
-    {Registry::Interface::LingmoVirtualDesktopManagement, {
-        2,
-        QByteArrayLiteral("org_kde_lingmo_virtual_desktop_management"),
-        &org_kde_lingmo_virtual_desktop_management_interface,
-        &Registry::lingmoVirtualDesktopManagementAnnounced,
-        &Registry::lingmoVirtualDesktopManagementRemoved
-    }},
-    {Registry::Interface::LingmoWindowManagement, {
+    },
+    {Registry::Interface::LingmoWindowManagement,
         18,
-        QByteArrayLiteral("org_kde_lingmo_window_management"),
+        "org_kde_lingmo_window_management",
         &org_kde_lingmo_window_management_interface,
         &Registry::lingmoWindowManagementAnnounced,
         &Registry::lingmoWindowManagementRemoved
-    }},
-    {Registry::Interface::FakeInput, {
+    },
+    {Registry::Interface::FakeInput,
         4,
-        QByteArrayLiteral("org_kde_kwin_fake_input"),
+        "org_kde_kwin_fake_input",
         &org_kde_kwin_fake_input_interface,
         &Registry::fakeInputAnnounced,
         &Registry::fakeInputRemoved
-    }},
-    {Registry::Interface::Shadow, {
+    },
+    {Registry::Interface::Shadow,
         2,
-        QByteArrayLiteral("org_kde_kwin_shadow_manager"),
+        "org_kde_kwin_shadow_manager",
         &org_kde_kwin_shadow_manager_interface,
         &Registry::shadowAnnounced,
         &Registry::shadowRemoved
-    }},
-    {Registry::Interface::Blur, {
+    },
+    {Registry::Interface::Blur,
         1,
-        QByteArrayLiteral("org_kde_kwin_blur_manager"),
+        "org_kde_kwin_blur_manager",
         &org_kde_kwin_blur_manager_interface,
         &Registry::blurAnnounced,
         &Registry::blurRemoved
-    }},
-    {Registry::Interface::Contrast, {
+    },
+    {Registry::Interface::Contrast,
         2,
-        QByteArrayLiteral("org_kde_kwin_contrast_manager"),
+        "org_kde_kwin_contrast_manager",
         &org_kde_kwin_contrast_manager_interface,
         &Registry::contrastAnnounced,
         &Registry::contrastRemoved
-    }},
-    {Registry::Interface::Slide, {
+    },
+    {Registry::Interface::Slide,
         1,
-        QByteArrayLiteral("org_kde_kwin_slide_manager"),
+        "org_kde_kwin_slide_manager",
         &org_kde_kwin_slide_manager_interface,
         &Registry::slideAnnounced,
         &Registry::slideRemoved
-    }},
-    {Registry::Interface::Dpms, {
+    },
+    {Registry::Interface::Dpms,
         1,
-        QByteArrayLiteral("org_kde_kwin_dpms_manager"),
+        "org_kde_kwin_dpms_manager",
         &org_kde_kwin_dpms_manager_interface,
         &Registry::dpmsAnnounced,
         &Registry::dpmsRemoved
-    }},
-    {Registry::Interface::TextInputManagerUnstableV0, {
+    },
+    {Registry::Interface::TextInputManagerUnstableV0,
         1,
-        QByteArrayLiteral("wl_text_input_manager"),
+        "wl_text_input_manager",
         &wl_text_input_manager_interface,
         &Registry::textInputManagerUnstableV0Announced,
         &Registry::textInputManagerUnstableV0Removed
-    }},
-    {Registry::Interface::TextInputManagerUnstableV2, {
+    },
+    {Registry::Interface::TextInputManagerUnstableV2,
         1,
-        QByteArrayLiteral("zwp_text_input_manager_v2"),
+        "zwp_text_input_manager_v2",
         &zwp_text_input_manager_v2_interface,
         &Registry::textInputManagerUnstableV2Announced,
         &Registry::textInputManagerUnstableV2Removed
-    }},
-    {Registry::Interface::XdgShellUnstableV5, {
+    },
+    {Registry::Interface::XdgShellUnstableV5,
         1,
-        QByteArrayLiteral("xdg_shell"),
+        "xdg_shell",
         &zxdg_shell_v5_interface,
         &Registry::xdgShellUnstableV5Announced,
         &Registry::xdgShellUnstableV5Removed
-    }},
-    {Registry::Interface::RelativePointerManagerUnstableV1, {
+    },
+    {Registry::Interface::RelativePointerManagerUnstableV1,
         1,
-        QByteArrayLiteral("zwp_relative_pointer_manager_v1"),
+        "zwp_relative_pointer_manager_v1",
         &zwp_relative_pointer_manager_v1_interface,
         &Registry::relativePointerManagerUnstableV1Announced,
         &Registry::relativePointerManagerUnstableV1Removed
-    }},
-    {Registry::Interface::PointerGesturesUnstableV1, {
+    },
+    {Registry::Interface::PointerGesturesUnstableV1,
         1,
-        QByteArrayLiteral("zwp_pointer_gestures_v1"),
+        "zwp_pointer_gestures_v1",
         &zwp_pointer_gestures_v1_interface,
         &Registry::pointerGesturesUnstableV1Announced,
         &Registry::pointerGesturesUnstableV1Removed
-    }},
-    {Registry::Interface::PointerConstraintsUnstableV1, {
+    },
+    {Registry::Interface::PointerConstraintsUnstableV1,
         1,
-        QByteArrayLiteral("zwp_pointer_constraints_v1"),
+        "zwp_pointer_constraints_v1",
         &zwp_pointer_constraints_v1_interface,
         &Registry::pointerConstraintsUnstableV1Announced,
         &Registry::pointerConstraintsUnstableV1Removed
-    }},
-    {Registry::Interface::XdgExporterUnstableV2, {
+    },
+    {Registry::Interface::XdgExporterUnstableV2,
         1,
-        QByteArrayLiteral("zxdg_exporter_v2"),
+        "zxdg_exporter_v2",
         &zxdg_exporter_v2_interface,
         &Registry::exporterUnstableV2Announced,
         &Registry::exporterUnstableV2Removed
-    }},
-    {Registry::Interface::XdgImporterUnstableV2, {
+    },
+    {Registry::Interface::XdgImporterUnstableV2,
         1,
-        QByteArrayLiteral("zxdg_importer_v2"),
+        "zxdg_importer_v2",
         &zxdg_importer_v2_interface,
         &Registry::importerUnstableV2Announced,
         &Registry::importerUnstableV2Removed
-    }},
-    {Registry::Interface::XdgShellUnstableV6, {
+    },
+    {Registry::Interface::XdgShellUnstableV6,
         1,
-        QByteArrayLiteral("zxdg_shell_v6"),
+        "zxdg_shell_v6",
         &zxdg_shell_v6_interface,
         &Registry::xdgShellUnstableV6Announced,
         &Registry::xdgShellUnstableV6Removed
-    }},
-    {Registry::Interface::IdleInhibitManagerUnstableV1, {
+    },
+    {Registry::Interface::IdleInhibitManagerUnstableV1,
         1,
-        QByteArrayLiteral("zwp_idle_inhibit_manager_v1"),
+        "zwp_idle_inhibit_manager_v1",
         &zwp_idle_inhibit_manager_v1_interface,
         &Registry::idleInhibitManagerUnstableV1Announced,
         &Registry::idleInhibitManagerUnstableV1Removed
-    }},
-    {Registry::Interface::AppMenu, {
+    },
+    {Registry::Interface::AppMenu,
         1,
-        QByteArrayLiteral("org_kde_kwin_appmenu_manager"),
+        "org_kde_kwin_appmenu_manager",
         &org_kde_kwin_appmenu_manager_interface,
         &Registry::appMenuAnnounced,
         &Registry::appMenuRemoved
-    }},
-    {Registry::Interface::XdgOutputUnstableV1, {
+    },
+    {Registry::Interface::LingmoVirtualDesktopManagement,
+        2,
+        "org_kde_lingmo_virtual_desktop_management",
+        &org_kde_lingmo_virtual_desktop_management_interface,
+        &Registry::lingmoVirtualDesktopManagementAnnounced,
+        &Registry::lingmoVirtualDesktopManagementRemoved
+    },
+    {Registry::Interface::XdgOutputUnstableV1,
         2,
-        QByteArrayLiteral("zxdg_output_manager_v1"),
+        "zxdg_output_manager_v1",
         &zxdg_output_manager_v1_interface,
         &Registry::xdgOutputAnnounced,
         &Registry::xdgOutputRemoved
-    }},
-    {Registry::Interface::XdgShellStable, {
+    },
+    {Registry::Interface::XdgShellStable,
         1,
-        QByteArrayLiteral("xdg_wm_base"),
+        "xdg_wm_base",
         &xdg_wm_base_interface,
         &Registry::xdgShellStableAnnounced,
         &Registry::xdgShellStableRemoved
-    }},
-    {Registry::Interface::XdgDecorationUnstableV1, {
+    },
+    {Registry::Interface::XdgDecorationUnstableV1,
         1,
-        QByteArrayLiteral("zxdg_decoration_manager_v1"),
+        "zxdg_decoration_manager_v1",
         &zxdg_decoration_manager_v1_interface,
         &Registry::xdgDecorationAnnounced,
         &Registry::xdgDecorationRemoved
-    }},
-    {Registry::Interface::LingmoActivationFeedback, {
+    },
+    {Registry::Interface::LingmoActivationFeedback,
         1,
-        QByteArrayLiteral("org_kde_lingmo_activation_feedback"),
+        "org_kde_lingmo_activation_feedback",
         &org_kde_lingmo_activation_feedback_interface,
         &Registry::lingmoActivationFeedbackAnnounced,
         &Registry::lingmoActivationFeedbackRemoved
-    }},
+    },
 };
 // clang-format on
+static constexpr std::size_t s_interfaceCount = std::size(s_interfaces);
 
-static quint32 maxVersion(const Registry::Interface &interface)
+static_assert(
+    [] {
+        for (std::size_t i = 0; i < s_interfaceCount; ++i) {
+            if (s_interfaces[i].interface != Registry::Interface(i)) {
+                return false;
+            }
+        }
+        return true;
+    }(),
+    "s_interfaces must be ordered like Registry::Interface");
+
+static constexpr const SuppertedInterfaceData *interfaceData(Registry::Interface interface)
 {
-    auto it = s_interfaces.find(interface);
-    if (it != s_interfaces.end()) {
-        return it.value().maxVersion;
+    const auto index = std::size_t(interface);
+    if (interface == Registry::Interface::Unknown || index >= s_interfaceCount) {
+        return nullptr;
     }
-    return 0;
+    return &s_interfaces[index];
+}
+
+// the known interfaces sorted by their name for looking them up through a binary search
+static constexpr auto s_interfacesByName = [] {
+    std::array<Registry::Interface, s_interfaceCount - 1> sorted{};
+    for (std::size_t i = 1; i < s_interfaceCount; ++i) {
+        sorted[i - 1] = s_interfaces[i].interface;
+    }
+    std::sort(sorted.begin(), sorted.end(), [](Registry::Interface a, Registry::Interface b) {
+        return s_interfaces[std::size_t(a)].name < s_interfaces[std::size_t(b)].name;
+    });
+    return sorted;
+}();
+
+static_assert(std::adjacent_find(s_interfacesByName.begin(),
+                                 s_interfacesByName.end(),
+                                 [](Registry::Interface a, Registry::Interface b) {
+                                     return s_interfaces[std::size_t(a)].name == s_interfaces[std::size_t(b)].name;
+                                 })
+                  == s_interfacesByName.end(),
+              "interface names must be unique");
+
+static constexpr Registry::Interface nameToInterface(std::string_view name)
+{
+    auto it = std::lower_bound(s_interfacesByName.begin(), s_interfacesByName.end(), name, [](Registry::Interface interface, std::string_view name) {
+        return s_interfaces[std::size_t(interface)].name < name;
+    });
+    if (it == s_interfacesByName.end() || s_interfaces[std::size_t(*it)].name != name) {
+        return Registry::Interface::Unknown;
+    }
+    return *it;
+}
+
+static_assert(nameToInterface("wl_compositor") == Registry::Interface::Compositor);
+static_assert(nameToInterface("wl_unknown") == Registry::Interface::Unknown);
+
+static constexpr quint32 maxVersion(Registry::Interface interface)
+{
+    const SuppertedInterfaceData *data = interfaceData(interface);
+    return data ? data->maxVersion : 0;
 }
 }
 
@@ -334,6 +396,16 @@ public:
     T *bind(Interface interface, uint32_t name, uint32_t version) const;
     template<class T, typename WL>
     T *create(quint32 name, quint32 version, QObject *parent, WL *(Registry::*bindMethod)(uint32_t, uint32_t) const);
+    /**
+     * Creates the wrapper for the global @p name of @p interface through the matching create method.
+     **/
+    QObject *createInterface(Interface interface, quint32 name, quint32 version);
+    void requestInterface(Interface interface, quint32 minimumVersion, Requirement requirement);
+    /**
+     * Binds the global @p name if @p interface got requested and is not bound yet.
+     **/
+    void bindRequested(Interface interface, uint32_t name, uint32_t version);
+    QObject *boundInterface(Interface interface) const;
 
     WaylandPointer<wl_registry, wl_registry_destroy> registry;
     static const struct wl_callback_listener s_callbackListener;
@@ -354,7 +426,22 @@ private:
         uint32_t name;
         uint32_t version;
     };
-    QList<InterfaceData> m_interfaces;
+    // announced globals of known interfaces by their name
+    QHash<uint32_t, InterfaceData> m_globals;
+    // names of the announced globals of each interface, in the order they got announced
+    std::array<QList<uint32_t>, s_interfaceCount> m_names;
+    struct RequestedInterface {
+        bool requested = false;
+        quint32 minimumVersion = 0;
+        Requirement requirement = Requirement::Required;
+        // the bound global
+        uint32_t name = 0;
+        QPointer<QObject> object;
+    };
+    std::array<RequestedInterface, s_interfaceCount> m_requested;
+    bool m_ready = false;
+
+    friend class Registry;
     static const struct wl_registry_listener s_registryListener;
 };
 
@@ -397,6 +484,7 @@ void Registry::create(wl_display *display)
 {
     Q_ASSERT(display);
     Q_ASSERT(!isValid());
+    d->m_ready = false;
     d->registry.setup(wl_display_get_registry(display));
     d->callback.setup(wl_display_sync(display));
     if (d->queue) {
@@ -468,19 +556,22 @@ void Registry::Private::globalSync(void *data, wl_callback *callback, uint32_t s
 void Registry::Private::handleGlobalSync()
 {
     Q_EMIT q->interfacesAnnounced();
-}
-
-namespace
-{
-static Registry::Interface nameToInterface(const char *interface)
-{
-    for (auto it = s_interfaces.constBegin(); it != s_interfaces.constEnd(); ++it) {
-        if (qstrcmp(interface, it.value().name) == 0) {
-            return it.key();
+    QList<Interface> missing;
+    QByteArrayList missingNames;
+    for (std::size_t i = 0; i < s_interfaceCount; ++i) {
+        const RequestedInterface &requested = m_requested[i];
+        if (requested.requested && requested.requirement == Requirement::Required && !requested.object) {
+            missing << Interface(i);
+            missingNames << QByteArray(s_interfaces[i].name.data(), s_interfaces[i].name.size());
         }
     }
-    return Registry::Interface::Unknown;
-}
+    if (!missing.isEmpty()) {
+        qCWarning(KWAYLAND_CLIENT) << "Required interfaces are missing:" << missingNames;
+        Q_EMIT q->requiredInterfacesMissing(missing);
+        return;
+    }
+    m_ready = true;
+    Q_EMIT q->ready();
 }
 
 void Registry::Private::handleAnnounce(uint32_t name, const char *interface, uint32_t version)
@@ -492,67 +583,111 @@ void Registry::Private::handleAnnounce(uint32_t name, const char *interface, uin
         return;
     }
     qCDebug(KWAYLAND_CLIENT) << "Wayland Interface: " << interface << "/" << name << "/" << version;
-    m_interfaces.append({i, name, version});
-    auto it = s_interfaces.constFind(i);
-    if (it != s_interfaces.end()) {
-        Q_EMIT(q->*it.value().announcedSignal)(name, version);
-    }
+    m_globals.insert(name, {i, name, version});
+    m_names[std::size_t(i)].append(name);
+    Q_EMIT(q->*s_interfaces[std::size_t(i)].announcedSignal)(name, version);
+    bindRequested(i, name, version);
 }
 
 void Registry::Private::handleRemove(uint32_t name)
 {
-    auto it = std::find_if(m_interfaces.begin(), m_interfaces.end(), [name](const InterfaceData &data) {
-        return data.name == name;
-    });
-    if (it != m_interfaces.end()) {
-        InterfaceData data = *(it);
-        m_interfaces.erase(it);
-        auto sit = s_interfaces.find(data.interface);
-        if (sit != s_interfaces.end()) {
-            Q_EMIT(q->*sit.value().removedSignal)(data.name);
+    auto it = m_globals.find(name);
+    if (it != m_globals.end()) {
+        const InterfaceData data = it.value();
+        m_globals.erase(it);
+        m_names[std::size_t(data.interface)].removeOne(name);
+        Q_EMIT(q->*s_interfaces[std::size_t(data.interface)].removedSignal)(data.name);
+        Q_EMIT q->interfaceRemoved(name);
+
+        RequestedInterface &requested = m_requested[std::size_t(data.interface)];
+        if (requested.object && requested.name == name) {
+            // the wrapper emitted removed through interfaceRemoved, replace it by another global if there is one
+            requested.object->deleteLater();
+            requested.object.clear();
+            const QList<uint32_t> names = m_names[std::size_t(data.interface)];
+            for (uint32_t other : names) {
+                bindRequested(data.interface, other, m_globals.value(other).version);
+            }
         }
+        return;
     }
     Q_EMIT q->interfaceRemoved(name);
 }
 
+void Registry::Private::requestInterface(Interface interface, quint32 minimumVersion, Requirement requirement)
+{
+    if (!interfaceData(interface)) {
+        return;
+    }
+    RequestedInterface &requested = m_requested[std::size_t(interface)];
+    requested.requested = true;
+    requested.minimumVersion = minimumVersion;
+    requested.requirement = requirement;
+    // the global might be announced already
+    const QList<uint32_t> names = m_names[std::size_t(interface)];
+    for (uint32_t name : names) {
+        bindRequested(interface, name, m_globals.value(name).version);
+    }
+}
+
+void Registry::Private::bindRequested(Interface interface, uint32_t name, uint32_t version)
+{
+    RequestedInterface &requested = m_requested[std::size_t(interface)];
+    if (!requested.requested || requested.object || version < requested.minimumVersion) {
+        return;
+    }
+    requested.name = name;
+    requested.object = createInterface(interface, name, version);
+}
+
+QObject *Registry::Private::boundInterface(Interface interface) const
+{
+    if (!interfaceData(interface)) {
+        return nullptr;
+    }
+    return m_requested[std::size_t(interface)].object;
+}
+
 bool Registry::Private::hasInterface(Registry::Interface interface) const
 {
-    auto it = std::find_if(m_interfaces.constBegin(), m_interfaces.constEnd(), [interface](const InterfaceData &data) {
-        return data.interface == interface;
-    });
-    return it != m_interfaces.constEnd();
+    return interfaceData(interface) && !m_names[std::size_t(interface)].isEmpty();
 }
 
 QList<Registry::AnnouncedInterface> Registry::Private::interfaces(Interface interface) const
 {
     QList<Registry::AnnouncedInterface> retVal;
-    for (auto it = m_interfaces.constBegin(); it != m_interfaces.constEnd(); ++it) {
-        const auto &data = *it;
-        if (data.interface == interface) {
-            retVal << AnnouncedInterface{data.name, data.version};
-        }
+    if (!interfaceData(interface)) {
+        return retVal;
+    }
+    const QList<uint32_t> &names = m_names[std::size_t(interface)];
+    retVal.reserve(names.size());
+    for (uint32_t name : names) {
+        retVal << AnnouncedInterface{name, m_globals.value(name).version};
     }
     return retVal;
 }
 
 Registry::AnnouncedInterface Registry::Private::interface(Interface interface) const
 {
-    const auto all = interfaces(interface);
-    if (!all.isEmpty()) {
-        return all.last();
+    if (hasInterface(interface)) {
+        const uint32_t name = m_names[std::size_t(interface)].last();
+        return AnnouncedInterface{name, m_globals.value(name).version};
     }
     return AnnouncedInterface{0, 0};
 }
 
 Registry::Interface Registry::Private::interfaceForName(quint32 name) const
 {
-    auto it = std::find_if(m_interfaces.constBegin(), m_interfaces.constEnd(), [name](const InterfaceData &data) {
-        return data.name == name;
-    });
-    if (it == m_interfaces.constEnd()) {
+    auto it = m_globals.constFind(name);
+    if (it == m_globals.constEnd()) {
         return Interface::Unknown;
     }
-    return (*it).interface;
+    return it->interface;
+}
+
+Registry::Interface Registry::interfaceForName(quint32 name) const
+{
+    return d->interfaceForName(name);
 }
 
 bool Registry::hasInterface(Registry::Interface interface) const
@@ -760,25 +895,103 @@ XdgDecorationManager *Registry::createXdgDecorationManager(quint32 name, quint32
     }
 }
 
-namespace
+QObject *Registry::Private::createInterface(Interface interface, quint32 name, quint32 version)
 {
-static const wl_interface *wlInterface(Registry::Interface interface)
-{
-    auto it = s_interfaces.find(interface);
-    if (it != s_interfaces.end()) {
-        return it.value().interface;
+    switch (interface) {
+    case Interface::Compositor:
+        return q->createCompositor(name, version, q);
+    case Interface::Shell:
+        return q->createShell(name, version, q);
+    case Interface::Seat:
+        return q->createSeat(name, version, q);
+    case Interface::Shm:
+        return q->createShmPool(name, version, q);
+    case Interface::Output:
+        return q->createOutput(name, version, q);
+    case Interface::SubCompositor:
+        return q->createSubCompositor(name, version, q);
+    case Interface::DataDeviceManager:
+        return q->createDataDeviceManager(name, version, q);
+    case Interface::LingmoShell:
+        return q->createLingmoShell(name, version, q);
+    case Interface::LingmoWindowManagement:
+        return q->createLingmoWindowManagement(name, version, q);
+    case Interface::FakeInput:
+        return q->createFakeInput(name, version, q);
+    case Interface::Shadow:
+        return q->createShadowManager(name, version, q);
+    case Interface::Blur:
+        return q->createBlurManager(name, version, q);
+    case Interface::Contrast:
+        return q->createContrastManager(name, version, q);
+    case Interface::Slide:
+        return q->createSlideManager(name, version, q);
+    case Interface::Dpms:
+        return q->createDpmsManager(name, version, q);
+    case Interface::TextInputManagerUnstableV0:
+    case Interface::TextInputManagerUnstableV2:
+        return q->createTextInputManager(name, version, q);
+    case Interface::XdgShellUnstableV5:
+    case Interface::XdgShellUnstableV6:
+    case Interface::XdgShellStable:
+        return q->createXdgShell(name, version, q);
+    case Interface::RelativePointerManagerUnstableV1:
+        return q->createRelativePointerManager(name, version, q);
+    case Interface::PointerGesturesUnstableV1:
+        return q->createPointerGestures(name, version, q);
+    case Interface::PointerConstraintsUnstableV1:
+        return q->createPointerConstraints(name, version, q);
+    case Interface::XdgExporterUnstableV2:
+        return q->createXdgExporter(name, version, q);
+    case Interface::XdgImporterUnstableV2:
+        return q->createXdgImporter(name, version, q);
+    case Interface::IdleInhibitManagerUnstableV1:
+        return q->createIdleInhibitManager(name, version, q);
+    case Interface::AppMenu:
+        return q->createAppMenuManager(name, version, q);
+    case Interface::LingmoVirtualDesktopManagement:
+        return q->createLingmoVirtualDesktopManagement(name, version, q);
+    case Interface::XdgOutputUnstableV1:
+        return q->createXdgOutputManager(name, version, q);
+    case Interface::XdgDecorationUnstableV1:
+        return q->createXdgDecorationManager(name, version, q);
+    case Interface::LingmoActivationFeedback:
+        return q->createLingmoActivationFeedback(name, version, q);
+    case Interface::Unknown:
+        break;
     }
     return nullptr;
 }
+
+void Registry::requestInterface(Interface interface, quint32 minimumVersion, Requirement requirement)
+{
+    d->requestInterface(interface, minimumVersion, requirement);
+}
+
+QObject *Registry::boundInterface(Interface interface) const
+{
+    return d->boundInterface(interface);
+}
+
+bool Registry::isReady() const
+{
+    return d->m_ready;
+}
+
+namespace
+{
+static constexpr const wl_interface *wlInterface(Registry::Interface interface)
+{
+    const SuppertedInterfaceData *data = interfaceData(interface);
+    return data ? data->wlInterface : nullptr;
+}
 }
 
 template<typename T>
 T *Registry::Private::bind(Registry::Interface interface, uint32_t name, uint32_t version) const
 {
-    auto it = std::find_if(m_interfaces.constBegin(), m_interfaces.constEnd(), [=](const InterfaceData &data) {
-        return data.interface == interface && data.name == name && data.version >= version;
-    });
-    if (it == m_interfaces.constEnd()) {
+    auto it = m_globals.constFind(name);
+    if (it == m_globals.constEnd() || it->interface != interface || it->version < version) {
         qCDebug(KWAYLAND_CLIENT) << "Don't have interface " << int(interface) << "with name " << name << "and minimum version" << version;
         return nullptr;
     }
@@ -115,6 +115,23 @@ class XdgDecorationManager;
  *
  * The interfaces are announced in an asynchronous way by the Wayland server.
  * To initiate the announcing of the interfaces one needs to call setup.
+ *
+ * Instead of connecting to the dedicated signals and creating the wrappers manually, the
+ * interfaces a client needs can be requested before calling setup. The Registry creates them
+ * on its EventQueue as soon as they are announced and emits ready once the initial announcing
+ * is done, so that no additional roundtrip is needed:
+ *
+ * @code
+ * registry.requestInterface(Registry::Interface::Compositor, 4);
+ * registry.requestInterface(Registry::Interface::Seat, 5, Registry::Requirement::Optional);
+ * connect(&registry, &Registry::ready, [&registry] {
+ *     Compositor *compositor = registry.boundInterface<Compositor>(Registry::Interface::Compositor);
+ * });
+ * registry.setup();
+ * @endcode
+ *
+ * Globals which are only needed occasionally can be wrapped in a LazyGlobal, which only
+ * invokes the create method once the wrapper is used for the first time.
  **/
 class KWAYLANDCLIENT_EXPORT Registry : public QObject
 {
@@ -159,6 +176,15 @@ public:
         XdgDecorationUnstableV1, ///< refers to zxdg_decoration_manager_v1 @since 5.54
         LingmoActivationFeedback, ///< Refers to org_kde_lingmo_activation_feedback interface, @since 5.83
     };
+    /**
+     * Whether an interface passed to requestInterface has to be announced for the Registry
+     * to become ready.
+     * @since 6.2
+     **/
+    enum class Requirement {
+        Required, ///< ready is only emitted if the interface got announced
+        Optional, ///< the interface is created if announced
+    };
     explicit Registry(QObject *parent = nullptr);
     ~Registry() override;
 
@@ -265,6 +291,53 @@ public:
      * @since 5.5
      **/
     QList<AnnouncedInterface> interfaces(Interface interface) const;
+    /**
+     * @returns The well-known interface of the announced global @p name, Interface::Unknown
+     * if there is no such global or it got removed already.
+     * @see LazyGlobal
+     * @since 6.2
+     **/
+    Interface interfaceForName(quint32 name) const;
+
+    /**
+     * Requests the Registry to create the wrapper for @p interface as soon as it gets announced
+     * with at least @p minimumVersion. The wrapper is created through the matching create method,
+     * with the Registry as parent and on the EventQueue of the Registry.
+     *
+     * Only one global is created per @p interface, if there are multiple, e.g. outputs, the
+     * first announced one is used. If it gets removed, the wrapper gets deleted and the next
+     * announced global of @p interface is created.
+     *
+     * Should be invoked before setup, so that the result is known once ready or
+     * requiredInterfacesMissing is emitted.
+     *
+     * @see boundInterface
+     * @see ready
+     * @since 6.2
+     **/
+    void requestInterface(Interface interface, quint32 minimumVersion = 1, Requirement requirement = Requirement::Required);
+    /**
+     * @returns The wrapper created for @p interface requested through requestInterface,
+     * @c nullptr if it did not get announced.
+     * @see requestInterface
+     * @since 6.2
+     **/
+    QObject *boundInterface(Interface interface) const;
+    /**
+     * Convenience overload casting the wrapper created for @p interface to @p T, e.g. Compositor.
+     * @since 6.2
+     **/
+    template<typename T>
+    T *boundInterface(Interface interface) const
+    {
+        return qobject_cast<T *>(boundInterface(interface));
+    }
+    /**
+     * @returns Whether the initial announcing finished and all required interfaces got created.
+     * @see ready
+     * @since 6.2
+     **/
+    bool isReady() const;
 
     /**
      * @name Low-level bind methods for global interfaces.
@@ -1500,6 +1573,21 @@ Q_SIGNALS:
      * This signal is emitted from the wl_display_sync callback.
      **/
     void interfacesAnnounced();
+    /**
+     * Emitted after interfacesAnnounced if all interfaces requested with Requirement::Required
+     * got created. The wrappers of all announced requested interfaces are available through
+     * boundInterface at this point.
+     * @see requestInterface
+     * @since 6.2
+     **/
+    void ready();
+    /**
+     * Emitted after interfacesAnnounced instead of ready, if some of the interfaces requested
+     * with Requirement::Required did not get announced in at least the requested version.
+     * @see requestInterface
+     * @since 6.2
+     **/
+    void requiredInterfacesMissing(const QList<KWayland::Client::Registry::Interface> &interfaces);
 
 Q_SIGNALS:
     /*
@@ -0,0 +1,93 @@
+/*
+    SPDX-FileCopyrightText: 2026 Lingmo OS Team
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+#include "roundtrip_p.h"
+// Qt
+#include <QMutexLocker>
+#include <QPromise>
+// wayland
+#include <wayland-client-protocol.h>
+
+namespace KWayland
+{
+namespace Client
+{
+struct PendingRoundtrips::Roundtrip {
+    PendingRoundtrips *owner;
+    wl_callback *callback = nullptr;
+    // a QPromise which gets destroyed unfinished cancels its QFuture
+    QPromise<void> promise;
+};
+
+#ifndef K_DOXYGEN
+const struct wl_callback_listener PendingRoundtrips::s_listener = {doneCallback};
+#endif
+
+PendingRoundtrips::~PendingRoundtrips()
+{
+    cancel(false);
+}
+
+QFuture<void> PendingRoundtrips::start(wl_display *display, wl_event_queue *queue)
+{
+    auto roundtrip = new Roundtrip{this};
+    roundtrip->promise.start();
+    QFuture<void> future = roundtrip->promise.future();
+    if (!display) {
+        delete roundtrip;
+        return future;
+    }
+    QMutexLocker locker(&mutex);
+    if (queue) {
+        // send the request through a wrapper, so that the callback is on the queue right from the start
+        auto wrapper = reinterpret_cast<wl_display *>(wl_proxy_create_wrapper(display));
+        if (!wrapper) {
+            // canceled like a roundtrip which could not be sent
+            delete roundtrip;
+            return future;
+        }
+        wl_proxy_set_queue(reinterpret_cast<wl_proxy *>(wrapper), queue);
+        roundtrip->callback = wl_display_sync(wrapper);
+        wl_proxy_wrapper_destroy(wrapper);
+    } else {
+        roundtrip->callback = wl_display_sync(display);
+    }
+    if (!roundtrip->callback) {
+        delete roundtrip;
+        return future;
+    }
+    wl_callback_add_listener(roundtrip->callback, &s_listener, roundtrip);
+    roundtrips << roundtrip;
+    return future;
+}
+
+void PendingRoundtrips::cancel(bool destroyCallbacks)
+{
+    QMutexLocker locker(&mutex);
+    for (Roundtrip *roundtrip : std::as_const(roundtrips)) {
+        if (destroyCallbacks) {
+            wl_callback_destroy(roundtrip->callback);
+        }
+        delete roundtrip;
+    }
+    roundtrips.clear();
+}
+
+void PendingRoundtrips::doneCallback(void *data, wl_callback *callback, uint32_t serial)
+{
+    Q_UNUSED(serial)
+    auto roundtrip = reinterpret_cast<Roundtrip *>(data);
+    Q_ASSERT(roundtrip->callback == callback);
+    {
+        QMutexLocker locker(&roundtrip->owner->mutex);
+        roundtrip->owner->roundtrips.removeOne(roundtrip);
+    }
+    wl_callback_destroy(callback);
+    roundtrip->promise.finish();
+    delete roundtrip;
+}
+
+}
+}
@@ -0,0 +1,58 @@
+/*
+    SPDX-FileCopyrightText: 2026 Lingmo OS Team
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+#ifndef WAYLAND_ROUNDTRIP_P_H
+#define WAYLAND_ROUNDTRIP_P_H
+
+#include <QFuture>
+#include <QList>
+#include <QMutex>
+
+struct wl_callback;
+struct wl_callback_listener;
+struct wl_display;
+struct wl_event_queue;
+
+namespace KWayland
+{
+namespace Client
+{
+/**
+ * Roundtrips to the Wayland server which did not finish yet.
+ *
+ * Each roundtrip sends a wl_display.sync request and finishes its QFuture once the
+ * Wayland server answered, which means that all requests sent before got processed.
+ **/
+class Q_DECL_HIDDEN PendingRoundtrips
+{
+public:
+    PendingRoundtrips() = default;
+    PendingRoundtrips(const PendingRoundtrips &) = delete;
+    ~PendingRoundtrips();
+
+    /**
+     * Starts a roundtrip on @p display whose answer gets dispatched on @p queue,
+     * or the default queue if @p queue is @c null.
+     * @returns A QFuture finishing with the roundtrip, already canceled without a @p display.
+     **/
+    QFuture<void> start(wl_display *display, wl_event_queue *queue = nullptr);
+    /**
+     * Cancels all roundtrips. Their callbacks get destroyed unless the connection
+     * is already gone, see @p destroyCallbacks.
+     **/
+    void cancel(bool destroyCallbacks = true);
+
+private:
+    struct Roundtrip;
+    static void doneCallback(void *data, wl_callback *callback, uint32_t serial);
+    static const struct wl_callback_listener s_listener;
+    QMutex mutex;
+    QList<Roundtrip *> roundtrips;
+};
+
+}
+}
+
+#endif
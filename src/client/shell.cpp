@@ -11,7 +11,7 @@
 #include "wayland_pointer_p.h"
 // Qt
 #include <QGuiApplication>
-#include <QList>
+#include <QHash>
 #include <qpa/qplatformnativeinterface.h>
 // Wayland
 #include <wayland-client-protocol.h>
@@ -113,10 +113,14 @@ class Q_DECL_HIDDEN ShellSurface::Private
 public:
     Private(ShellSurface *q);
     void setup(wl_shell_surface *surface);
+    /**
+     * Removes the native surface from s_surfaces, unless it got reused by another ShellSurface.
+     **/
+    void removeFromIndex();
 
     WaylandPointer<wl_shell_surface, wl_shell_surface_destroy> surface;
     QSize size;
-    static QList<ShellSurface *> s_surfaces;
+    static QHash<wl_shell_surface *, ShellSurface *> s_surfaces;
 
 private:
     void ping(uint32_t serial);
@@ -128,7 +132,7 @@ private:
     static const struct wl_shell_surface_listener s_listener;
 };
 
-QList<ShellSurface *> ShellSurface::Private::s_surfaces = QList<ShellSurface *>();
+QHash<wl_shell_surface *, ShellSurface *> ShellSurface::Private::s_surfaces;
 
 ShellSurface::Private::Private(ShellSurface *q)
     : q(q)
@@ -140,9 +144,18 @@ void ShellSurface::Private::setup(wl_shell_surface *s)
     Q_ASSERT(s);
     Q_ASSERT(!surface);
     surface.setup(s);
+    s_surfaces.insert(s, q);
     wl_shell_surface_add_listener(surface, &s_listener, this);
 }
 
+void ShellSurface::Private::removeFromIndex()
+{
+    auto it = s_surfaces.find(surface);
+    if (it != s_surfaces.end() && *it == q) {
+        s_surfaces.erase(it);
+    }
+}
+
 ShellSurface *ShellSurface::fromWindow(QWindow *window)
 {
     if (!window) {
@@ -162,6 +175,7 @@ ShellSurface *ShellSurface::fromWindow(QWindow *window)
     }
     ShellSurface *surface = new ShellSurface(window);
     surface->d->surface.setup(s, true);
+    Private::s_surfaces.insert(s, surface);
     return surface;
 }
 
@@ -184,35 +198,29 @@ ShellSurface *ShellSurface::fromQtWinId(WId wid)
 
 ShellSurface *ShellSurface::get(wl_shell_surface *native)
 {
-    auto it = std::find_if(Private::s_surfaces.constBegin(), Private::s_surfaces.constEnd(), [native](ShellSurface *s) {
-        return s->d->surface == native;
-    });
-    if (it != Private::s_surfaces.constEnd()) {
-        return *(it);
-    }
-    return nullptr;
+    return Private::s_surfaces.value(native);
 }
 
 ShellSurface::ShellSurface(QObject *parent)
     : QObject(parent)
     , d(new Private(this))
 {
-    Private::s_surfaces << this;
 }
 
 ShellSurface::~ShellSurface()
 {
-    Private::s_surfaces.removeOne(this);
     release();
 }
 
 void ShellSurface::release()
 {
+    d->removeFromIndex();
     d->surface.release();
 }
 
 void ShellSurface::destroy()
 {
+    d->removeFromIndex();
     d->surface.destroy();
 }
 
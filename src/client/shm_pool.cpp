@@ -7,14 +7,21 @@
 #include "buffer_p.h"
 #include "event_queue.h"
 #include "logging.h"
-#include "wayland_pointer_p.h"
+#include "shm_pool_p.h"
+#include "surface.h"
 // Qt
 #include <QDebug>
+#include <QDeadlineTimer>
 #include <QImage>
 // system
+#include <errno.h>
 #include <fcntl.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <unistd.h>
+
+#include <algorithm>
+#include <limits>
 // wayland
 #include <wayland-client-protocol.h>
 
@@ -22,32 +29,65 @@ namespace KWayland
 {
 namespace Client
 {
-class Q_DECL_HIDDEN ShmPool::Private
+class Q_DECL_HIDDEN ShmImage::Private
 {
 public:
-    Private(ShmPool *q);
-    bool createPool();
-    bool resizePool(int32_t newSize);
-    QList<QSharedPointer<Buffer>>::iterator getBuffer(const QSize &size, int32_t stride, Buffer::Format format);
-    WaylandPointer<wl_shm, wl_shm_destroy> shm;
-    WaylandPointer<wl_shm_pool, wl_shm_pool_destroy> pool;
-    void *poolData = nullptr;
-    int fd = -1;
-    int32_t size = 1024;
-    bool valid = false;
-    int offset = 0;
-    QList<QSharedPointer<Buffer>> buffers;
-    EventQueue *queue = nullptr;
-
-private:
-    ShmPool *q;
+    QWeakPointer<Buffer> buffer;
+    QImage image;
+    QImage::Format format = QImage::Format_Invalid;
 };
 
+#ifndef K_DOXYGEN
+const struct wl_shm_listener ShmPool::Private::s_listener = {formatCallback};
+#endif
+
 ShmPool::Private::Private(ShmPool *q)
     : q(q)
 {
 }
 
+ShmPool::Private::~Private()
+{
+    delete pressureNotifier;
+    if (pressureFd != -1) {
+        close(pressureFd);
+    }
+}
+
+namespace
+{
+static std::optional<Buffer::Format> fromWaylandFormat(uint32_t format)
+{
+    switch (format) {
+    case WL_SHM_FORMAT_ARGB8888:
+        return Buffer::Format::ARGB32;
+    case WL_SHM_FORMAT_XRGB8888:
+        return Buffer::Format::RGB32;
+    case WL_SHM_FORMAT_RGB565:
+        return Buffer::Format::RGB565;
+    case WL_SHM_FORMAT_ABGR8888:
+        return Buffer::Format::ABGR32;
+    case WL_SHM_FORMAT_XBGR8888:
+        return Buffer::Format::XBGR32;
+    case WL_SHM_FORMAT_ARGB2101010:
+        return Buffer::Format::ARGB2101010;
+    default:
+        return std::nullopt;
+    }
+}
+}
+
+void ShmPool::Private::formatCallback(void *data, wl_shm *shm, uint32_t format)
+{
+    auto p = reinterpret_cast<ShmPool::Private *>(data);
+    Q_ASSERT(p->shm == shm);
+    const auto bufferFormat = fromWaylandFormat(format);
+    QMutexLocker locker(&p->mutex);
+    if (bufferFormat && !p->formats.contains(*bufferFormat)) {
+        p->formats.append(*bufferFormat);
+    }
+}
+
 ShmPool::ShmPool(QObject *parent)
     : QObject(parent)
     , d(new Private(this))
@@ -61,52 +101,72 @@ ShmPool::~ShmPool()
 
 void ShmPool::release()
 {
+    QMutexLocker locker(&d->mutex);
+    d->releasedBuffers.clear();
+    d->damageHistory.clear();
     d->buffers.clear();
-    if (d->poolData) {
-        munmap(d->poolData, d->size);
-        d->poolData = nullptr;
-    }
-    if (d->fd != -1) {
-        close(d->fd);
-        d->fd = -1;
-    }
+    d->destroyPool();
+    d->poolWrapper.release();
     d->pool.release();
     d->shm.release();
     d->valid = false;
-    d->offset = 0;
 }
 
 void ShmPool::destroy()
 {
+    QMutexLocker locker(&d->mutex);
     for (auto b : d->buffers) {
         b->d->destroy();
     }
+    d->releasedBuffers.clear();
+    d->damageHistory.clear();
     d->buffers.clear();
-    if (d->poolData) {
-        munmap(d->poolData, d->size);
-        d->poolData = nullptr;
-    }
-    if (d->fd != -1) {
-        close(d->fd);
-        d->fd = -1;
-    }
+    d->destroyPool();
+    d->poolWrapper.destroy();
     d->pool.destroy();
     d->shm.destroy();
     d->valid = false;
-    d->offset = 0;
 }
 
 void ShmPool::setup(wl_shm *shm)
 {
     Q_ASSERT(shm);
     Q_ASSERT(!d->shm);
+    QMutexLocker locker(&d->mutex);
     d->shm.setup(shm);
+    d->formats = {Buffer::Format::ARGB32, Buffer::Format::RGB32};
+    wl_shm_add_listener(shm, &Private::s_listener, d.data());
     d->valid = d->createPool();
 }
 
+void ShmPool::setGrowthFactor(qreal factor)
+{
+    d->growthFactor = qMax<qreal>(1.0, factor);
+}
+
+qreal ShmPool::growthFactor() const
+{
+    return d->growthFactor;
+}
+
+void ShmPool::setAllocationHints(AllocationHints hints)
+{
+    d->allocationHints = hints;
+}
+
+ShmPool::AllocationHints ShmPool::allocationHints() const
+{
+    return d->allocationHints;
+}
+
 void ShmPool::setEventQueue(EventQueue *queue)
 {
+    QMutexLocker locker(&d->mutex);
     d->queue = queue;
+    d->poolWrapper.release();
+    if (d->pool) {
+        d->createPoolWrapper();
+    }
 }
 
 EventQueue *ShmPool::eventQueue()
@@ -145,83 +205,452 @@ bool ShmPool::Private::createPool()
         qCDebug(KWAYLAND_CLIENT) << "Could not set size for Shm pool file";
         return false;
     }
-    poolData = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (!reserveAddressSpace()) {
+        qCDebug(KWAYLAND_CLIENT) << "Could not reserve address space for Shm pool";
+        return false;
+    }
+    const void *data = mmap(poolData, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
     pool.setup(wl_shm_create_pool(shm, fd, size));
 
-    if (poolData == MAP_FAILED || !pool) {
+    if (data == MAP_FAILED || !pool) {
         qCDebug(KWAYLAND_CLIENT) << "Creating Shm pool failed";
         return false;
     }
+    prepareRange(0, size);
+    freeRanges.clear();
+    freeRanges.insert(0, size);
+    freeBytes = size;
+    createPoolWrapper();
     return true;
 }
 
-bool ShmPool::Private::resizePool(int32_t newSize)
+bool ShmPool::Private::reserveAddressSpace()
+{
+    // a pool cannot exceed int32_t, a 32 bit process cannot spare that much for every pool though
+    size_t length = sizeof(void *) > 4 ? size_t(1) << 31 : size_t(1) << 26;
+    for (; length >= size_t(size); length /= 2) {
+        void *address = mmap(nullptr, length, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (address != MAP_FAILED) {
+            poolData = address;
+            reservedSize = length;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ShmPool::Private::createPoolWrapper()
+{
+    if (!queue || !queue->isValid()) {
+        return;
+    }
+    wl_shm_pool *native = pool;
+    auto wrapper = reinterpret_cast<wl_shm_pool *>(wl_proxy_create_wrapper(native));
+    if (!wrapper) {
+        return;
+    }
+    wl_proxy_set_queue(reinterpret_cast<wl_proxy *>(wrapper), *queue);
+    poolWrapper.setup(wrapper);
+}
+
+void ShmPool::Private::destroyPoolWrapper(wl_shm_pool *wrapper)
+{
+    wl_proxy_wrapper_destroy(wrapper);
+}
+
+void ShmPool::Private::destroyPool()
+{
+    QWriteLocker locker(&mappingLock);
+    if (poolData) {
+        munmap(poolData, reservedSize);
+        poolData = nullptr;
+        reservedSize = 0;
+    }
+    if (fd != -1) {
+        close(fd);
+        fd = -1;
+    }
+    freeRanges.clear();
+    freeBytes = 0;
+}
+
+bool ShmPool::Private::resizePool(int32_t requestedSize)
 {
+    qint64 newSize = qMax<qint64>(requestedSize, size * growthFactor);
+    if (newSize > requestedSize) {
+        // growing geometrically anyway, so make use of the complete last page
+        const qint64 pageSize = sysconf(_SC_PAGESIZE);
+        newSize = (newSize + pageSize - 1) / pageSize * pageSize;
+    }
+    newSize = qMin<qint64>(newSize, qMin<qint64>(reservedSize, std::numeric_limits<int32_t>::max()));
+    if (newSize < requestedSize) {
+        qCDebug(KWAYLAND_CLIENT) << "Shm pool cannot grow beyond its reserved address space";
+        return false;
+    }
     if (ftruncate(fd, newSize) < 0) {
         qCDebug(KWAYLAND_CLIENT) << "Could not set new size for Shm pool file";
         return false;
     }
-    wl_shm_pool_resize(pool, newSize);
-    munmap(poolData, size);
-    poolData = mmap(nullptr, newSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    // the pool grows into its reservation, so the addresses of existing Buffers stay valid
+    const qint64 pageSize = sysconf(_SC_PAGESIZE);
+    const qint64 mappedEnd = (size + pageSize - 1) / pageSize * pageSize;
+    if (newSize > mappedEnd) {
+        void *tail = static_cast<char *>(poolData) + mappedEnd;
+        if (mmap(tail, newSize - mappedEnd, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, mappedEnd) == MAP_FAILED) {
+            // the old mapping is still intact, keep using it
+            qCDebug(KWAYLAND_CLIENT) << "Resizing Shm pool failed";
+            return false;
+        }
+    }
+    const int32_t oldSize = size;
     size = newSize;
-    if (poolData == MAP_FAILED) {
-        qCDebug(KWAYLAND_CLIENT) << "Resizing Shm pool failed";
+    // only tell the Wayland server once the pool can be used with the new size
+    wl_shm_pool_resize(pool, newSize);
+    prepareRange(oldSize, size - oldSize);
+    deallocate(oldSize, size - oldSize);
+    Q_EMIT q->poolResized();
+    return true;
+}
+
+void ShmPool::Private::prepareRange(int32_t offset, int32_t length)
+{
+    if (allocationHints & AllocationHint::Reserve) {
+        if (const int error = posix_fallocate(fd, offset, length)) {
+            qCDebug(KWAYLAND_CLIENT) << "Could not reserve memory for Shm pool:" << strerror(error);
+        }
+    }
+    if (allocationHints & AllocationHint::Prefault) {
+        // madvise needs a page aligned address
+        const int32_t pageSize = sysconf(_SC_PAGESIZE);
+        const int32_t start = offset / pageSize * pageSize;
+        char *address = static_cast<char *>(poolData) + start;
+        length += offset - start;
+#ifdef MADV_POPULATE_WRITE
+        if (madvise(address, length, MADV_POPULATE_WRITE) == 0) {
+            return;
+        }
+#endif
+        madvise(address, length, MADV_WILLNEED);
+    }
+}
+
+int32_t ShmPool::Private::alignedSize(int32_t byteCount)
+{
+    return (byteCount + s_alignment - 1) & ~(s_alignment - 1);
+}
+
+int32_t ShmPool::Private::allocate(int32_t byteCount)
+{
+    byteCount = alignedSize(byteCount);
+    auto bestFit = freeRanges.end();
+    for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it) {
+        if (it.value() < byteCount) {
+            continue;
+        }
+        if (bestFit == freeRanges.end() || it.value() < bestFit.value()) {
+            bestFit = it;
+            if (it.value() == byteCount) {
+                break;
+            }
+        }
+    }
+    if (bestFit == freeRanges.end()) {
+        return -1;
+    }
+    const int32_t offset = bestFit.key();
+    const int32_t remaining = bestFit.value() - byteCount;
+    freeRanges.erase(bestFit);
+    if (remaining > 0) {
+        freeRanges.insert(offset + byteCount, remaining);
+    }
+    freeBytes -= byteCount;
+    highWaterMark = qMax<qint64>(highWaterMark, size - freeBytes);
+    return offset;
+}
+
+void ShmPool::Private::deallocate(int32_t offset, int32_t byteCount)
+{
+    byteCount = alignedSize(byteCount);
+    if (byteCount <= 0) {
+        return;
+    }
+    freeBytes += byteCount;
+    auto next = freeRanges.lowerBound(offset);
+    if (next != freeRanges.end() && offset + byteCount == next.key()) {
+        byteCount += next.value();
+        next = freeRanges.erase(next);
+    }
+    if (next != freeRanges.begin()) {
+        auto previous = std::prev(next);
+        if (previous.key() + previous.value() == offset) {
+            previous.value() += byteCount;
+            return;
+        }
+    }
+    freeRanges.insert(offset, byteCount);
+}
+
+bool ShmPool::Private::reclaimIdleBuffers()
+{
+    if (releasedBuffers.isEmpty()) {
         return false;
     }
-    Q_EMIT q->poolResized();
+    const auto idle = std::exchange(releasedBuffers, {});
+    for (const auto &stack : idle) {
+        for (Buffer *buffer : stack) {
+            deallocate(buffer->d->offset, buffer->size().height() * buffer->stride());
+            buffers.remove(buffer);
+        }
+    }
     return true;
 }
 
-namespace
+bool ShmPool::Private::reclaimIdleBuffers(int32_t byteCount)
+{
+    if (releasedBuffers.isEmpty()) {
+        return false;
+    }
+    byteCount = alignedSize(byteCount);
+    struct Range {
+        int32_t offset;
+        int32_t length;
+        // the idle Buffer holding the range, nullptr for a free range
+        Buffer *buffer;
+    };
+    QList<Range> ranges;
+    for (auto it = freeRanges.constBegin(); it != freeRanges.constEnd(); ++it) {
+        ranges.append(Range{it.key(), it.value(), nullptr});
+    }
+    for (const auto &stack : std::as_const(releasedBuffers)) {
+        for (Buffer *buffer : stack) {
+            ranges.append(Range{buffer->d->offset, alignedSize(buffer->size().height() * buffer->stride()), buffer});
+        }
+    }
+    std::sort(ranges.begin(), ranges.end(), [](const Range &a, const Range &b) {
+        return a.offset < b.offset;
+    });
+    // sliding window over adjacent ranges, cost are the idle bytes which would be given up
+    qsizetype bestFirst = -1;
+    qsizetype bestLast = -1;
+    qint64 bestCost = std::numeric_limits<qint64>::max();
+    qsizetype first = 0;
+    qint64 cost = 0;
+    for (qsizetype last = 0; last < ranges.size(); ++last) {
+        if (last > 0 && ranges[last - 1].offset + ranges[last - 1].length != ranges[last].offset) {
+            // a live Buffer lies in between
+            first = last;
+            cost = 0;
+        }
+        if (ranges[last].buffer) {
+            cost += ranges[last].length;
+        }
+        const int32_t end = ranges[last].offset + ranges[last].length;
+        while (first < last && end - ranges[first + 1].offset >= byteCount) {
+            if (ranges[first].buffer) {
+                cost -= ranges[first].length;
+            }
+            ++first;
+        }
+        if (end - ranges[first].offset >= byteCount && cost < bestCost) {
+            bestFirst = first;
+            bestLast = last;
+            bestCost = cost;
+        }
+    }
+    if (bestFirst < 0) {
+        return false;
+    }
+    for (qsizetype i = bestFirst; i <= bestLast; ++i) {
+        Buffer *buffer = ranges[i].buffer;
+        if (!buffer) {
+            continue;
+        }
+        auto it = releasedBuffers.find(BufferKey{buffer->size(), buffer->stride(), buffer->format()});
+        it->removeOne(buffer);
+        if (it->isEmpty()) {
+            releasedBuffers.erase(it);
+        }
+        deallocate(buffer->d->offset, buffer->size().height() * buffer->stride());
+        buffers.remove(buffer);
+    }
+    return true;
+}
+
+void ShmPool::Private::checkIdle()
 {
-static Buffer::Format toBufferFormat(const QImage &image)
+    QMutexLocker locker(&mutex);
+    if (trimmedSinceActivity || (lastActivity.isValid() && !lastActivity.hasExpired(idleTrimTimeout))) {
+        return;
+    }
+    trimmedSinceActivity = true;
+    locker.unlock();
+    q->trim();
+}
+
+void ShmPool::Private::bufferStateChanged(Buffer *buffer)
 {
+    const BufferKey key{buffer->size(), buffer->stride(), buffer->format()};
+    if (buffer->isReleased() && !buffer->isUsed()) {
+        releasedBuffers[key].append(buffer);
+        return;
+    }
+    auto it = releasedBuffers.find(key);
+    if (it == releasedBuffers.end()) {
+        return;
+    }
+    // getBuffer always takes the last one, so check it before scanning
+    if (!it->isEmpty() && it->last() == buffer) {
+        it->removeLast();
+    } else {
+        it->removeOne(buffer);
+    }
+    if (it->isEmpty()) {
+        releasedBuffers.erase(it);
+    }
+}
+
+QRegion ShmPool::Private::updateDamage(Buffer *buffer, const QRegion &damage, Surface *surface)
+{
+    const QRect bufferRect(QPoint(0, 0), buffer->size());
+    if (!surface) {
+        buffer->d->history = 0;
+        buffer->d->sequence = 0;
+        return bufferRect;
+    }
+    auto it = damageHistory.find(surface);
+    if (it == damageHistory.end()) {
+        it = damageHistory.insert(surface, DamageHistory{});
+        // a Surface created at the same address must not find the history
+        QObject::connect(
+            surface,
+            &QObject::destroyed,
+            q,
+            [this, surface] {
+                QMutexLocker locker(&mutex);
+                damageHistory.remove(surface);
+            },
+            Qt::DirectConnection);
+    }
+    DamageHistory &history = *it;
+    const BufferKey key{buffer->size(), buffer->stride(), buffer->format()};
+    if (history.id == 0 || !(history.buffer == key)) {
+        // images of another size do not share any content
+        history = DamageHistory{++lastDamageHistoryId, key};
+    }
+    const QRegion clippedDamage = damage & bufferRect;
+    const quint64 age = history.sequence - buffer->d->sequence;
+    QRegion region = clippedDamage;
+    if (buffer->d->sequence == 0 || buffer->d->history != history.id || age > quint64(history.regions.size())) {
+        // the content of the buffer is unknown, from another surface or too old
+        region = bufferRect;
+    } else {
+        for (auto it = history.regions.cend() - age; it != history.regions.cend(); ++it) {
+            region += *it;
+        }
+    }
+    history.regions.append(clippedDamage);
+    if (history.regions.size() > s_maxBufferAge) {
+        history.regions.removeFirst();
+    }
+    buffer->d->history = history.id;
+    buffer->d->sequence = ++history.sequence;
+    return region;
+}
+
+void ShmPool::Private::copyContent(Buffer *buffer, const uchar *src, int32_t srcStride, const QRegion &region, PixelConversion conversion)
+{
+    if (conversion == PixelConversion::None) {
+        buffer->copy(src, srcStride, region);
+        return;
+    }
+    QReadLocker locker(&mappingLock);
+    const int32_t stride = buffer->stride();
+    uchar *dst = reinterpret_cast<uchar *>(poolData) + buffer->d->offset;
+    for (const QRect &rect : region) {
+        const size_t dstOffset = rect.y() * stride + rect.x() * 4;
+        const size_t srcOffset = rect.y() * srcStride + rect.x() * 4;
+        if (rect.width() * 4 == stride && srcStride == stride) {
+            // full scanlines are contiguous
+            convertPixels(conversion, dst + dstOffset, src + srcOffset, rect.width() * rect.height());
+            continue;
+        }
+        for (int y = 0; y < rect.height(); ++y) {
+            convertPixels(conversion, dst + dstOffset + y * stride, src + srcOffset + y * srcStride, rect.width());
+        }
+    }
+}
+
+Buffer::Format ShmPool::Private::chooseFormat(const QImage &image) const
+{
+    const auto native = bufferFormat(image.format());
+    if (native && formats.contains(*native)) {
+        return *native;
+    }
     switch (image.format()) {
     case QImage::Format_ARGB32_Premultiplied:
+    case QImage::Format_ARGB32:
+    case QImage::Format_RGBA8888_Premultiplied:
+    case QImage::Format_RGBA8888:
         return Buffer::Format::ARGB32;
     case QImage::Format_RGB32:
+    case QImage::Format_RGBX8888:
+    case QImage::Format_RGB16:
         return Buffer::Format::RGB32;
-    case QImage::Format_ARGB32:
-        qCWarning(KWAYLAND_CLIENT) << "Unsupported image format: " << image.format() << ". expect slow performance. Use QImage::Format_ARGB32_Premultiplied";
-        return Buffer::Format::ARGB32;
     default:
         qCWarning(KWAYLAND_CLIENT) << "Unsupported image format: " << image.format() << ". expect slow performance.";
         return Buffer::Format::ARGB32;
     }
 }
-}
 
 Buffer::Ptr ShmPool::createBuffer(const QImage &image)
 {
-    if (image.isNull() || !d->valid) {
+    return createBuffer(image, QRect(QPoint(0, 0), image.size()), nullptr);
+}
+
+Buffer::Ptr ShmPool::createBuffer(const QImage &image, const QRegion &damage, Surface *surface)
+{
+    if (image.isNull()) {
+        return QWeakPointer<Buffer>();
+    }
+    QMutexLocker locker(&d->mutex);
+    if (!d->valid) {
         return QWeakPointer<Buffer>();
     }
-    auto format = toBufferFormat(image);
-    auto it = d->getBuffer(image.size(), image.bytesPerLine(), format);
-    if (it == d->buffers.end()) {
+    const auto format = d->chooseFormat(image);
+    auto buffer = d->getBuffer(image.size(), bufferStride(image.width(), format), format);
+    if (!buffer) {
         return QWeakPointer<Buffer>();
     }
-    if (format == Buffer::Format::ARGB32 && image.format() != QImage::Format_ARGB32_Premultiplied) {
-        auto imageCopy = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
-        (*it)->copy(imageCopy.bits());
+    const QRegion region = d->updateDamage(buffer.data(), damage, surface);
+    // the Buffer is handed out now, so other threads can get Buffers while this one gets filled
+    locker.unlock();
+    if (const auto conversion = pixelConversion(image.format(), format)) {
+        // convert while copying into the pool
+        d->copyContent(buffer.data(), image.constBits(), image.bytesPerLine(), region, *conversion);
     } else {
-        (*it)->copy(image.bits());
+        auto imageCopy = image.convertToFormat(format == Buffer::Format::RGB32 ? QImage::Format_RGB32 : QImage::Format_ARGB32_Premultiplied);
+        d->copyContent(buffer.data(), imageCopy.constBits(), imageCopy.bytesPerLine(), region, PixelConversion::None);
     }
-    return QWeakPointer<Buffer>(*it);
+    return buffer.toWeakRef();
 }
 
 Buffer::Ptr ShmPool::createBuffer(const QSize &size, int32_t stride, const void *src, Buffer::Format format)
 {
-    if (size.isEmpty() || !d->valid) {
+    if (size.isEmpty()) {
         return QWeakPointer<Buffer>();
     }
-    auto it = d->getBuffer(size, stride, format);
-    if (it == d->buffers.end()) {
+    QMutexLocker locker(&d->mutex);
+    if (!d->valid) {
         return QWeakPointer<Buffer>();
     }
-    (*it)->copy(src);
-    return QWeakPointer<Buffer>(*it);
+    auto buffer = d->getBuffer(size, stride, format);
+    if (!buffer) {
+        return QWeakPointer<Buffer>();
+    }
+    const QRegion region = d->updateDamage(buffer.data(), QRect(QPoint(0, 0), size), nullptr);
+    locker.unlock();
+    d->copyContent(buffer.data(), reinterpret_cast<const uchar *>(src), stride, region, PixelConversion::None);
+    return buffer.toWeakRef();
 }
 
 namespace
@@ -233,6 +662,14 @@ static wl_shm_format toWaylandFormat(Buffer::Format format)
         return WL_SHM_FORMAT_ARGB8888;
     case Buffer::Format::RGB32:
         return WL_SHM_FORMAT_XRGB8888;
+    case Buffer::Format::RGB565:
+        return WL_SHM_FORMAT_RGB565;
+    case Buffer::Format::ABGR32:
+        return WL_SHM_FORMAT_ABGR8888;
+    case Buffer::Format::XBGR32:
+        return WL_SHM_FORMAT_XBGR8888;
+    case Buffer::Format::ARGB2101010:
+        return WL_SHM_FORMAT_ARGB2101010;
     }
     abort();
 }
@@ -240,53 +677,320 @@ static wl_shm_format toWaylandFormat(Buffer::Format format)
 
 Buffer::Ptr ShmPool::getBuffer(const QSize &size, int32_t stride, Buffer::Format format)
 {
-    auto it = d->getBuffer(size, stride, format);
-    if (it == d->buffers.end()) {
+    QMutexLocker locker(&d->mutex);
+    auto buffer = d->getBuffer(size, stride, format);
+    if (!buffer) {
         return QWeakPointer<Buffer>();
     }
-    return QWeakPointer<Buffer>(*it);
+    // the caller changes the content without telling us
+    buffer->d->sequence = 0;
+    return buffer.toWeakRef();
 }
 
-QList<QSharedPointer<Buffer>>::iterator ShmPool::Private::getBuffer(const QSize &s, int32_t stride, Buffer::Format format)
+Buffer::Ptr ShmPool::waitForFreeBuffer(const QSize &size, int32_t stride, Buffer::Format format, int timeout)
 {
-    for (auto it = buffers.begin(); it != buffers.end(); ++it) {
-        auto buffer = *it;
-        if (!buffer->isReleased() || buffer->isUsed()) {
-            continue;
+    const Private::BufferKey key{size, stride, format};
+    const QDeadlineTimer deadline(timeout);
+    while (true) {
+        EventQueue *queue = nullptr;
+        {
+            QMutexLocker locker(&d->mutex);
+            if (!d->valid) {
+                return QWeakPointer<Buffer>();
+            }
+            if (d->releasedBuffers.contains(key)) {
+                // take it while still holding the lock, another thread might be waiting for it as well
+                return getBuffer(size, stride, format);
+            }
+            queue = d->queue;
         }
-        if (buffer->size() != s || buffer->stride() != stride || buffer->format() != format) {
-            continue;
+        if (!queue || deadline.hasExpired()) {
+            return QWeakPointer<Buffer>();
         }
+        // the release events need the lock, so don't hold it while waiting
+        if (!queue->waitForEvents(deadline.isForever() ? -1 : int(deadline.remainingTime()))) {
+            return QWeakPointer<Buffer>();
+        }
+    }
+}
+
+QSharedPointer<Buffer> ShmPool::Private::getBuffer(const QSize &s, int32_t stride, Buffer::Format format)
+{
+    lastActivity.start();
+    trimmedSinceActivity = false;
+    auto it = releasedBuffers.constFind(BufferKey{s, stride, format});
+    if (it != releasedBuffers.constEnd()) {
+        // reuse the most recently released buffer, taking it out of releasedBuffers
+        Buffer *buffer = it->last();
         buffer->setReleased(false);
-        return it;
+        return buffers.value(buffer);
     }
+    // we don't have a buffer which we could reuse - need to create a new one
     const int32_t byteCount = s.height() * stride;
-    if (offset + byteCount > size) {
-        if (!resizePool(size + byteCount)) {
-            return buffers.end();
+    int32_t offset = allocate(byteCount);
+    if (offset < 0 && reclaimIdleBuffers(byteCount)) {
+        // just enough idle buffers of a different size gave their memory back
+        offset = allocate(byteCount);
+    }
+    if (offset < 0) {
+        // grow the pool so that the free range at its end can hold the new buffer
+        int32_t tailFree = 0;
+        if (!freeRanges.isEmpty()) {
+            auto last = std::prev(freeRanges.end());
+            if (last.key() + last.value() == size) {
+                tailFree = last.value();
+            }
+        }
+        if (!resizePool(size + alignedSize(byteCount) - tailFree)) {
+            return {};
+        }
+        offset = allocate(byteCount);
+        if (offset < 0) {
+            return {};
         }
     }
-    // we don't have a buffer which we could reuse - need to create a new one
-    wl_buffer *native = wl_shm_pool_create_buffer(pool, offset, s.width(), s.height(), stride, toWaylandFormat(format));
+    // creating it through the wrapper puts it on the queue before any event for it can be read
+    wl_shm_pool *creator = pool;
+    if (poolWrapper.isValid()) {
+        creator = poolWrapper;
+    }
+    wl_buffer *native = wl_shm_pool_create_buffer(creator, offset, s.width(), s.height(), stride, toWaylandFormat(format));
     if (!native) {
-        return buffers.end();
+        deallocate(offset, byteCount);
+        return {};
     }
-    if (queue) {
+    if (queue && !poolWrapper.isValid()) {
         queue->addProxy(native);
     }
     Buffer *buffer = new Buffer(q, native, s, stride, offset, format);
-    offset += byteCount;
-    auto it = buffers.insert(buffers.end(), QSharedPointer<Buffer>(buffer));
-    return it;
+    QSharedPointer<Buffer> sharedBuffer(buffer);
+    buffers.insert(buffer, sharedBuffer);
+    return sharedBuffer;
+}
+
+ShmImage ShmPool::createImage(const QSize &size, QImage::Format format)
+{
+    if (size.isEmpty()) {
+        return ShmImage();
+    }
+    QMutexLocker locker(&d->mutex);
+    if (!d->valid) {
+        return ShmImage();
+    }
+    const auto native = bufferFormat(format);
+    if (!native || !d->formats.contains(*native)) {
+        qCWarning(KWAYLAND_CLIENT) << "Unsupported image format for painting into a Buffer: " << format;
+        return ShmImage();
+    }
+    auto buffer = d->getBuffer(size, bufferStride(size.width(), *native), *native);
+    if (!buffer) {
+        return ShmImage();
+    }
+    buffer->setUsed(true);
+    buffer->d->sequence = 0;
+    ShmImage image;
+    image.d->buffer = buffer.toWeakRef();
+    image.d->format = format;
+    return image;
+}
+
+void ShmPool::trim()
+{
+    QMutexLocker locker(&d->mutex);
+    if (!d->valid) {
+        return;
+    }
+    d->reclaimIdleBuffers();
+    if (d->buffers.isEmpty() && d->size > Private::s_initialSize) {
+        // nothing references the pool anymore, start over with a small one
+        d->poolWrapper.release();
+        d->pool.release();
+        d->destroyPool();
+        d->size = Private::s_initialSize;
+        d->valid = d->createPool();
+        Q_EMIT poolResized();
+        return;
+    }
+#ifdef FALLOC_FL_PUNCH_HOLE
+    // the pool can only grow, but the memory backing the free ranges can be handed back
+    const int32_t pageSize = sysconf(_SC_PAGESIZE);
+    for (auto it = d->freeRanges.constBegin(); it != d->freeRanges.constEnd(); ++it) {
+        const int32_t start = (it.key() + pageSize - 1) / pageSize * pageSize;
+        const int32_t end = (it.key() + it.value()) / pageSize * pageSize;
+        if (end > start && fallocate(d->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, start, end - start) == -1) {
+            // e.g. not supported by the file system, the other ranges would fail the same way
+            qCDebug(KWAYLAND_CLIENT) << "Could not give unused memory of Shm pool back:" << strerror(errno);
+            break;
+        }
+    }
+#endif
+}
+
+ShmImage::ShmImage()
+    : d(new Private)
+{
+}
+
+ShmImage::ShmImage(ShmImage &&other)
+    : d(std::exchange(other.d, std::make_unique<Private>()))
+{
+}
+
+ShmImage &ShmImage::operator=(ShmImage &&other)
+{
+    if (this != &other) {
+        d.swap(other.d);
+    }
+    return *this;
+}
+
+ShmImage::~ShmImage()
+{
+    if (auto buffer = d->buffer.toStrongRef()) {
+        // never attached, the content is of no interest so the pool may reuse it directly
+        d->image = QImage();
+        buffer->setUsed(false);
+        buffer->setReleased(true);
+    }
+}
+
+bool ShmImage::isNull() const
+{
+    return d->buffer.isNull();
+}
+
+Buffer::Ptr ShmImage::buffer() const
+{
+    return d->buffer;
+}
+
+QImage &ShmImage::image()
+{
+    auto buffer = d->buffer.toStrongRef();
+    if (!buffer) {
+        d->image = QImage();
+        return d->image;
+    }
+    if (d->image.isNull() || d->image.constBits() != buffer->address()) {
+        // the image got dropped on attach, or the pool got recreated by trim
+        const QSize size = buffer->size();
+        d->image = QImage(buffer->address(), size.width(), size.height(), buffer->stride(), d->format);
+    }
+    return d->image;
+}
+
+void ShmImage::attach(Surface *surface, const QPoint &offset)
+{
+    auto buffer = d->buffer.toStrongRef();
+    if (!buffer) {
+        return;
+    }
+    d->image = QImage();
+    d->buffer.clear();
+    surface->attachBuffer(buffer.data(), offset);
+    buffer->setUsed(false);
+}
+
+ShmPool::Statistics ShmPool::statistics() const
+{
+    QMutexLocker locker(&d->mutex);
+    Statistics statistics;
+    if (!d->poolData) {
+        return statistics;
+    }
+    statistics.mappedBytes = d->size;
+    statistics.freeBytes = d->freeBytes;
+    statistics.highWaterMark = d->highWaterMark;
+    for (auto it = d->releasedBuffers.constBegin(); it != d->releasedBuffers.constEnd(); ++it) {
+        statistics.idleBytes += Private::alignedSize(it.key().size.height() * it.key().stride) * it->size();
+    }
+    statistics.liveBytes = d->size - d->freeBytes - statistics.idleBytes;
+    for (auto it = d->buffers.constBegin(); it != d->buffers.constEnd(); ++it) {
+        ++statistics.bufferCount[it.key()->format()];
+    }
+    return statistics;
+}
+
+void ShmPool::setIdleTrimTimeout(int msec)
+{
+    msec = qMax(0, msec);
+    d->idleTrimTimeout = msec;
+    if (msec == 0) {
+        delete d->idleTimer;
+        d->idleTimer = nullptr;
+        return;
+    }
+    if (!d->idleTimer) {
+        d->idleTimer = new QTimer(this);
+        connect(d->idleTimer, &QTimer::timeout, this, [this] {
+            d->checkIdle();
+        });
+    }
+    d->idleTimer->start(msec);
+}
+
+int ShmPool::idleTrimTimeout() const
+{
+    return d->idleTrimTimeout;
+}
+
+bool ShmPool::setTrimOnMemoryPressure(bool enable)
+{
+    if (enable == trimOnMemoryPressure()) {
+        return true;
+    }
+    if (!enable) {
+        delete d->pressureNotifier;
+        d->pressureNotifier = nullptr;
+        close(d->pressureFd);
+        d->pressureFd = -1;
+        return true;
+    }
+    const int fd = open("/proc/pressure/memory", O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd == -1) {
+        qCDebug(KWAYLAND_CLIENT) << "Memory pressure information is not available:" << strerror(errno);
+        return false;
+    }
+    // some task stalled for 150 ms within 2 s, which is the shortest window unprivileged processes may use
+    static const char trigger[] = "some 150000 2000000";
+    if (write(fd, trigger, sizeof(trigger)) < 0) {
+        qCDebug(KWAYLAND_CLIENT) << "Could not monitor memory pressure:" << strerror(errno);
+        close(fd);
+        return false;
+    }
+    d->pressureFd = fd;
+    // the kernel signals the trigger as an exceptional condition (POLLPRI)
+    d->pressureNotifier = new QSocketNotifier(fd, QSocketNotifier::Exception, this);
+    connect(d->pressureNotifier, &QSocketNotifier::activated, this, &ShmPool::trim);
+    return true;
+}
+
+bool ShmPool::trimOnMemoryPressure() const
+{
+    return d->pressureNotifier != nullptr;
+}
+
+QList<Buffer::Format> ShmPool::supportedFormats() const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->formats;
+}
+
+bool ShmPool::isFormatSupported(Buffer::Format format) const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->formats.contains(format);
 }
 
 bool ShmPool::isValid() const
 {
+    QMutexLocker locker(&d->mutex);
     return d->valid;
 }
 
 void *ShmPool::poolAddress() const
 {
+    QReadLocker locker(&d->mappingLock);
     return d->poolData;
 }
 
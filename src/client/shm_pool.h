@@ -6,12 +6,15 @@
 #ifndef WAYLAND_SHM_POOL_H
 #define WAYLAND_SHM_POOL_H
 
+#include <QImage>
+#include <QMap>
 #include <QObject>
 
+#include <memory>
+
 #include "KWayland/Client/kwaylandclient_export.h"
 #include "buffer.h"
 
-class QImage;
 class QSize;
 
 struct wl_shm;
@@ -21,6 +24,74 @@ namespace KWayland
 namespace Client
 {
 class EventQueue;
+class ShmPool;
+class Surface;
+
+/**
+ * @short Guard for painting directly into a Buffer of a ShmPool.
+ *
+ * A ShmImage holds a Buffer together with a QImage which shares the memory of the Buffer.
+ * Rendering into the image() with e.g. QPainter thus writes straight into the shared memory
+ * without any additional copy. As long as the ShmImage holds the Buffer, the Buffer is marked
+ * as used and the ShmPool does not hand it out again.
+ *
+ * Once painting is finished the Buffer gets attached to a Surface through attach(). This ends
+ * the usage of the Buffer and the ShmImage becomes null. If the ShmImage gets destroyed without
+ * being attached, the Buffer is handed back to the ShmPool for reuse.
+ * @code
+ * ShmImage target = pool->createImage(QSize(24, 24));
+ * QPainter p(&target.image());
+ * p.fillRect(0, 0, 24, 24, Qt::red);
+ * p.end();
+ * target.attach(surface);
+ * surface->damageBuffer(QRect(0, 0, 24, 24));
+ * surface->commit(Surface::CommitFlag::None);
+ * @endcode
+ *
+ * @see ShmPool::createImage
+ * @since 6.2
+ **/
+class KWAYLANDCLIENT_EXPORT ShmImage
+{
+public:
+    /**
+     * Creates a null ShmImage.
+     **/
+    ShmImage();
+    ShmImage(ShmImage &&other);
+    ShmImage &operator=(ShmImage &&other);
+    ~ShmImage();
+
+    /**
+     * @returns @c true if the ShmImage does not hold a Buffer.
+     **/
+    bool isNull() const;
+    /**
+     * @returns The Buffer the image() paints into.
+     **/
+    Buffer::Ptr buffer() const;
+    /**
+     * The QImage sharing the memory of buffer().
+     *
+     * The memory of the Buffer stays at the same address while the ShmPool grows, so the
+     * image can be painted on while other Buffers are requested from the ShmPool.
+     *
+     * @returns The QImage to paint on, a null QImage if the ShmImage is null.
+     **/
+    QImage &image();
+    /**
+     * Attaches the Buffer to @p surface at @p offset and gives up the usage of the Buffer.
+     * Any painting on the image() must be finished before. Afterwards the ShmImage is null.
+     *
+     * Damaging and committing the @p surface is left to the caller.
+     **/
+    void attach(Surface *surface, const QPoint &offset = QPoint());
+
+private:
+    friend class ShmPool;
+    class Private;
+    std::unique_ptr<Private> d;
+};
 
 /**
  * @short Wrapper class for wl_shm interface.
@@ -50,6 +121,13 @@ class EventQueue;
  * @li the stride matches
  * @li the format matches
  *
+ * The memory of the pool is managed by a best-fit allocator. If no Buffer can be reused and
+ * there is not enough free memory in the pool, the ShmPool first destroys the Buffers which
+ * are released and not used, so that their memory can be reused for the new Buffer, before
+ * it grows the pool. Call trim() to give unused memory of the pool back to the system, or
+ * let the ShmPool do so on its own when idle or under memory pressure, see setIdleTrimTimeout
+ * and setTrimOnMemoryPressure. How the memory of the pool is used is provided by statistics().
+ *
  * The ownership of a Buffer stays with ShmPool. The ShmPool might destroy the
  * Buffer at any given time. Because of that ShmPool only provides QWeakPointer
  * for Buffers. Users should always check whether the pointer is still valid and
@@ -88,6 +166,14 @@ class EventQueue;
  * image.fill(Qt::black);
  * @endcode
  *
+ * For painting into the Buffer the ShmImage guard takes care of creating the QImage and
+ * marking the Buffer as used until it is attached:
+ * @code
+ * ShmImage target = s->createImage(QSize(24, 24));
+ * target.image().fill(Qt::black);
+ * target.attach(surface);
+ * @endcode
+ *
  * A Buffer can be attached to a Surface:
  * @code
  * Compositor *c = registry.createCompositor(name, version);
@@ -106,9 +192,16 @@ class EventQueue;
  * @endcode
  *
  * This is also important for the case that the shared memory pool needs to be resized.
- * The ShmPool will automatically resize if it cannot provide a new Buffer. During the resize
- * all existing Buffers are unmapped and any shared objects must be recreated. The ShmPool emits
- * the signal poolResized() after the pool got resized.
+ * The ShmPool will automatically resize if it cannot provide a new Buffer. The pool grows in
+ * place, existing Buffers keep their address. The ShmPool emits the signal poolResized() after
+ * the pool got resized.
+ *
+ * Buffers can be requested, filled and released from multiple threads, e.g. to render tiles
+ * on a thread pool. Allocation and the released state of the Buffers are guarded by the
+ * ShmPool, and Buffer::copy may run concurrently to the pool being resized. An address obtained
+ * through Buffer::address stays valid for as long as the Buffer exists. Note that poolResized()
+ * is emitted on the thread which caused the resize, which need not be the thread of the ShmPool.
+ * Use a Qt::QueuedConnection to handle it on another thread.
  *
  * @see Buffer
  **/
@@ -116,6 +209,59 @@ class KWAYLANDCLIENT_EXPORT ShmPool : public QObject
 {
     Q_OBJECT
 public:
+    /**
+     * Hints on how the memory of the shared memory pool gets allocated.
+     * @see setAllocationHints
+     * @since 6.2
+     **/
+    enum class AllocationHint {
+        None = 0,
+        /**
+         * Fault in the pages of the pool when it is created or grown, instead of
+         * taking page faults on first access.
+         **/
+        Prefault = 1 << 0,
+        /**
+         * Reserve the memory backing the pool when it is created or grown, so that
+         * the memory is guaranteed to be available.
+         **/
+        Reserve = 1 << 1,
+    };
+    Q_DECLARE_FLAGS(AllocationHints, AllocationHint)
+
+    /**
+     * Memory usage of the shared memory pool.
+     * @see statistics
+     * @since 6.2
+     **/
+    struct Statistics {
+        /**
+         * The size of the shared memory pool.
+         **/
+        qint64 mappedBytes = 0;
+        /**
+         * The bytes held by Buffers which are used or not released by the Wayland server.
+         **/
+        qint64 liveBytes = 0;
+        /**
+         * The bytes held by Buffers which are released and not used. They are kept for
+         * reuse, but can be given back by trim().
+         **/
+        qint64 idleBytes = 0;
+        /**
+         * The bytes of the pool not held by any Buffer.
+         **/
+        qint64 freeBytes = 0;
+        /**
+         * The largest amount of bytes held by Buffers at the same time.
+         **/
+        qint64 highWaterMark = 0;
+        /**
+         * The number of Buffers for each format.
+         **/
+        QMap<Buffer::Format, int> bufferCount;
+    };
+
     explicit ShmPool(QObject *parent = nullptr);
     ~ShmPool() override;
     /**
@@ -156,8 +302,44 @@ public:
      **/
     void destroy();
 
+    /**
+     * Sets the factor by which the shared memory pool grows at least whenever it needs
+     * to be resized. The default of @c 1.0 grows the pool just by the amount needed
+     * for the new Buffer. A larger factor, e.g. @c 1.5, grows the pool geometrically
+     * and thus avoids resizing the pool on every frame while a Surface gets resized.
+     *
+     * @see growthFactor
+     * @since 6.2
+     **/
+    void setGrowthFactor(qreal factor);
+    /**
+     * @returns The factor by which the shared memory pool grows at least.
+     * @see setGrowthFactor
+     * @since 6.2
+     **/
+    qreal growthFactor() const;
+    /**
+     * Sets the @p hints on how the memory of the shared memory pool gets allocated.
+     * The hints apply whenever the pool gets created or grown the next time.
+     * By default no hint is set.
+     *
+     * @see allocationHints
+     * @since 6.2
+     **/
+    void setAllocationHints(AllocationHints hints);
+    /**
+     * @returns The hints on how the memory of the shared memory pool gets allocated.
+     * @see setAllocationHints
+     * @since 6.2
+     **/
+    AllocationHints allocationHints() const;
+
     /**
      * Sets the @p queue to use for creating a Buffer.
+     *
+     * The Buffers get created on the @p queue directly, so that no event for a new
+     * Buffer can be dispatched on another queue, even if the Buffer is requested from
+     * a thread other than the one dispatching the @p queue.
      **/
     void setEventQueue(EventQueue *queue);
     /**
@@ -175,11 +357,38 @@ public:
      * The content of the @p image is <b>copied</b> into the buffer. The @p image and
      * returned Buffer do <b>not</b> share memory.
      *
+     * If the compositor supports a Buffer::Format with the memory layout of the @p image, that
+     * format is used and the content is copied as is. Otherwise images in QImage::Format_ARGB32,
+     * QImage::Format_RGBA8888, QImage::Format_RGBA8888_Premultiplied and QImage::Format_RGBX8888
+     * get converted while being copied. Any other format requires an intermediate conversion of
+     * the complete image.
+     *
      * @param image The image which should be copied into the Buffer
      * @return Buffer with copied content of @p image in success case, a @c null Buffer::Ptr otherwise
      * @see getBuffer
      **/
     Buffer::Ptr createBuffer(const QImage &image);
+    /**
+     * Provides a Buffer like createBuffer(const QImage &), but only copies what is needed.
+     *
+     * The @p image is going to be attached to @p surface, as a ShmPool is usually shared by
+     * all surfaces of a process. The @p damage describes the area of @p image which changed
+     * since the previous image for the @p surface was passed to createBuffer. The ShmPool
+     * remembers the damage of the most recent images of each @p surface, so that a reused Buffer
+     * only gets the scanline spans copied which are stale, that is @p damage and everything which
+     * changed since the Buffer got last filled. A Buffer which is too old or got last filled for
+     * another @p surface gets the complete @p image copied, as does every Buffer if @p surface is
+     * @c nullptr. The history of a @p surface starts over once the size of its images changes,
+     * and gets dropped once the @p surface is destroyed.
+     *
+     * @param image The image which should be copied into the Buffer
+     * @param damage The area of @p image which changed since the previous image for the @p surface
+     * @param surface The Surface the Buffer is going to be attached to
+     * @return Buffer with the content of @p image in success case, a @c null Buffer::Ptr otherwise
+     * @see Buffer::copy
+     * @since 6.2
+     **/
+    Buffer::Ptr createBuffer(const QImage &image, const QRegion &damage, Surface *surface);
     /**
      * Provides a Buffer with @p size, @p stride and @p format.
      *
@@ -210,14 +419,133 @@ public:
      * @see createBuffer
      **/
     Buffer::Ptr getBuffer(const QSize &size, int32_t stride, Buffer::Format format = Buffer::Format::ARGB32);
+    /**
+     * Provides a released Buffer with @p size, @p stride and @p format without allocating
+     * a new one.
+     *
+     * If no such Buffer is available, the eventQueue() gets dispatched until the Wayland
+     * server releases a matching Buffer or @p timeout milliseconds passed. A negative
+     * @p timeout waits forever. Together with bufferReleased() this allows to render with a
+     * fixed number of Buffers.
+     *
+     * This method requires an EventQueue to be set through setEventQueue.
+     *
+     * @param size The requested size for the Buffer
+     * @param stride The requested stride for the Buffer
+     * @param format The requested format for the Buffer
+     * @param timeout The maximum time to wait in milliseconds
+     * @return Buffer as requested in success case, a @c null Buffer::Ptr on timeout.
+     * @see getBuffer
+     * @see bufferReleased
+     * @since 6.2
+     **/
+    Buffer::Ptr waitForFreeBuffer(const QSize &size, int32_t stride, Buffer::Format format, int timeout = -1);
+    /**
+     * Provides a ShmImage of @p size and @p format to paint into without any copy.
+     *
+     * The Buffer is marked as used as long as the returned ShmImage holds it. The @p format
+     * must share its memory layout with a Buffer::Format supported by the compositor, e.g.
+     * QImage::Format_ARGB32_Premultiplied and QImage::Format_RGB32 are always supported.
+     *
+     * If the ShmPool fails to provide such a Buffer a null ShmImage is returned.
+     *
+     * @param size The requested size for the image
+     * @param format The requested format of the image
+     * @return ShmImage sharing the memory of a Buffer in success case, a null ShmImage otherwise.
+     * @see ShmImage
+     * @since 6.2
+     **/
+    ShmImage createImage(const QSize &size, QImage::Format format = QImage::Format_ARGB32_Premultiplied);
+    /**
+     * The Buffer formats announced by the compositor through wl_shm.format. Buffer::Format::ARGB32
+     * and Buffer::Format::RGB32 are always supported, other formats only get known once the
+     * compositor announced them after setup, e.g. after a roundtrip.
+     *
+     * @returns The Buffer formats which can be used with this ShmPool.
+     * @since 6.2
+     **/
+    QList<Buffer::Format> supportedFormats() const;
+    /**
+     * @returns @c true if the compositor announced support for @p format.
+     * @see supportedFormats
+     * @since 6.2
+     **/
+    bool isFormatSupported(Buffer::Format format) const;
+    /**
+     * Destroys all Buffers which are released and not used and gives the unused memory of the
+     * pool back to the system.
+     *
+     * The Wayland protocol only allows to grow a pool. Because of that the memory backing the
+     * free ranges is discarded while the pool keeps its size. If no Buffer is left, the shared
+     * memory pool is recreated with its initial size and poolResized() is emitted.
+     *
+     * @since 6.2
+     **/
+    void trim();
+    /**
+     * @returns The current memory usage of the shared memory pool.
+     * @since 6.2
+     **/
+    Statistics statistics() const;
+    /**
+     * Sets the time in milliseconds after which the ShmPool trims itself if no Buffer got
+     * requested in the meantime. A value of @c 0, the default, disables trimming when idle.
+     *
+     * The ShmPool checks for being idle every @p msec, so the actual trim might happen up to
+     * twice the time after the last Buffer got requested. It gets trimmed only once for each
+     * idle period. This method must be called from the thread the ShmPool lives in.
+     *
+     * @see trim
+     * @see idleTrimTimeout
+     * @since 6.2
+     **/
+    void setIdleTrimTimeout(int msec);
+    /**
+     * @returns The time in milliseconds after which an idle ShmPool trims itself, @c 0 if disabled.
+     * @see setIdleTrimTimeout
+     * @since 6.2
+     **/
+    int idleTrimTimeout() const;
+    /**
+     * Sets whether the ShmPool trims itself when the system is under memory pressure.
+     *
+     * The memory pressure is monitored through the pressure stall information of the kernel.
+     * The ShmPool gets trimmed whenever tasks stalled on memory for more than 150 milliseconds
+     * within two seconds. This method must be called from the thread the ShmPool lives in.
+     *
+     * @returns @c false if monitoring the memory pressure is not possible on this system
+     * @see trim
+     * @since 6.2
+     **/
+    bool setTrimOnMemoryPressure(bool enable);
+    /**
+     * @returns Whether the ShmPool trims itself when the system is under memory pressure.
+     * @see setTrimOnMemoryPressure
+     * @since 6.2
+     **/
+    bool trimOnMemoryPressure() const;
     wl_shm *shm();
 Q_SIGNALS:
     /**
      * This signal is emitted whenever the shared memory pool gets resized.
-     * Any used Buffer must be remapped.
+     * Buffers keep their address when the pool grows. Only trim() recreates the pool, and
+     * only once no Buffer is left.
+     *
+     * The signal is emitted directly from the thread which requested the Buffer causing the
+     * resize, which need not be the thread of the ShmPool. Receivers living on another thread
+     * have to use a Qt::QueuedConnection.
      **/
     void poolResized();
 
+    /**
+     * This signal is emitted whenever the Wayland server released the @p buffer.
+     * Unless the Buffer is marked as used, it can be reused from now on.
+     * @see Buffer::isReleased
+     * @see waitForFreeBuffer
+     * @since 6.2
+     **/
+    void bufferReleased(KWayland::Client::Buffer::Ptr buffer);
+
     /**
      * The corresponding global for this interface on the Registry got removed.
      *
@@ -229,10 +557,13 @@ Q_SIGNALS:
     void removed();
 
 private:
+    friend class Buffer;
     class Private;
     QScopedPointer<Private> d;
 };
 
+Q_DECLARE_OPERATORS_FOR_FLAGS(ShmPool::AllocationHints)
+
 }
 }
 
@@ -0,0 +1,180 @@
+/*
+    SPDX-FileCopyrightText: 2013 Martin Gräßlin <mgraesslin@kde.org>
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+#ifndef WAYLAND_SHM_POOL_P_H
+#define WAYLAND_SHM_POOL_P_H
+
+#include "pixelconversion_p.h"
+#include "shm_pool.h"
+#include "wayland_pointer_p.h"
+// Qt
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMap>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QSharedPointer>
+#include <QSocketNotifier>
+#include <QTimer>
+// wayland
+#include <wayland-client-protocol.h>
+
+namespace KWayland
+{
+namespace Client
+{
+class Q_DECL_HIDDEN ShmPool::Private
+{
+public:
+    Private(ShmPool *q);
+    ~Private();
+    bool createPool();
+    /**
+     * Reserves address space for the largest pool, so that growing the pool never moves it.
+     * Sets poolData to the start of the reservation.
+     **/
+    bool reserveAddressSpace();
+    /**
+     * Grows the pool to hold at least @p requestedSize bytes, applying growthFactor.
+     **/
+    bool resizePool(int32_t requestedSize);
+    /**
+     * Applies the allocationHints to the range of the pool at @p offset.
+     **/
+    void prepareRange(int32_t offset, int32_t length);
+    void destroyPool();
+    /**
+     * Creates the poolWrapper if an EventQueue is set.
+     **/
+    void createPoolWrapper();
+    static void destroyPoolWrapper(wl_shm_pool *wrapper);
+    QSharedPointer<Buffer> getBuffer(const QSize &size, int32_t stride, Buffer::Format format);
+    /**
+     * Reserves @p byteCount bytes in the pool using a best-fit search over the free ranges.
+     * @returns the offset of the reserved range or @c -1 if no free range is large enough.
+     **/
+    int32_t allocate(int32_t byteCount);
+    /**
+     * Gives the range at @p offset back to the pool, merging it with adjacent free ranges.
+     **/
+    void deallocate(int32_t offset, int32_t byteCount);
+    /**
+     * Destroys all Buffers which are released and not used and thus only occupy memory.
+     * @returns @c true if at least one Buffer got destroyed
+     **/
+    bool reclaimIdleBuffers();
+    /**
+     * Destroys the fewest idle Buffers needed to get a free range of @p byteCount bytes, picking
+     * the adjacent free and idle ranges which give up the least idle bytes.
+     * @returns @c false without destroying any Buffer if no such ranges exist.
+     **/
+    bool reclaimIdleBuffers(int32_t byteCount);
+    /**
+     * Trims the pool if no Buffer got requested for idleTrimTimeout.
+     **/
+    void checkIdle();
+    /**
+     * Invoked by @p buffer whenever its released or used state changes to keep
+     * releasedBuffers up to date.
+     **/
+    void bufferStateChanged(Buffer *buffer);
+    /**
+     * Records @p damage in the damage history of @p surface and marks @p buffer as holding its most
+     * recent frame. Without a @p surface no history is kept.
+     * @returns @p damage and everything which changed since @p buffer got last updated for @p surface.
+     **/
+    QRegion updateDamage(Buffer *buffer, const QRegion &damage, Surface *surface);
+    /**
+     * Copies @p region from @p src with scanlines @p srcStride bytes apart into @p buffer,
+     * converting the pixels with @p conversion.
+     * Only holds the mappingLock, so that Buffers can be filled in parallel.
+     **/
+    void copyContent(Buffer *buffer, const uchar *src, int32_t srcStride, const QRegion &region, PixelConversion conversion);
+    /**
+     * @returns The cheapest format supported by the compositor to hold the content of @p image.
+     **/
+    Buffer::Format chooseFormat(const QImage &image) const;
+    static int32_t alignedSize(int32_t byteCount);
+    WaylandPointer<wl_shm, wl_shm_destroy> shm;
+    WaylandPointer<wl_shm_pool, wl_shm_pool_destroy> pool;
+    // pool on the EventQueue, so that Buffers get created on it without racing its dispatch
+    WaylandPointer<wl_shm_pool, destroyPoolWrapper> poolWrapper;
+    // start of the address space reserved for the pool, the file is mapped at its beginning
+    void *poolData = nullptr;
+    size_t reservedSize = 0;
+    int fd = -1;
+    int32_t size = s_initialSize;
+    bool valid = false;
+    // offset -> length of the unused ranges in the pool, adjacent ranges are always merged
+    QMap<int32_t, int32_t> freeRanges;
+    QHash<Buffer *, QSharedPointer<Buffer>> buffers;
+
+    struct BufferKey {
+        QSize size;
+        int32_t stride;
+        Buffer::Format format;
+        bool operator==(const BufferKey &other) const
+        {
+            return size == other.size && stride == other.stride && format == other.format;
+        }
+        friend size_t qHash(const BufferKey &key, size_t seed = 0)
+        {
+            return qHashMulti(seed, key.size.width(), key.size.height(), key.stride, static_cast<int>(key.format));
+        }
+    };
+    // Buffers which are released and not used, the most recently released one is last
+    QHash<BufferKey, QList<Buffer *>> releasedBuffers;
+
+    struct DamageHistory {
+        // identifies the history in Buffer::Private::history, never reused
+        quint64 id = 0;
+        // size, stride and format of the images
+        BufferKey buffer;
+        // the most recent frame, Buffers holding it have Buffer::Private::sequence set to it
+        quint64 sequence = 0;
+        // damage of the most recent frames, the last entry belongs to sequence
+        QList<QRegion> regions;
+    };
+    // Buffers are shared by all surfaces, so each one has its own history, which gets
+    // dropped once the Surface is destroyed and started over once its images change in size
+    QHash<Surface *, DamageHistory> damageHistory;
+    quint64 lastDamageHistoryId = 0;
+    // formats announced by the compositor, ARGB32 and RGB32 are always supported
+    QList<Buffer::Format> formats;
+    EventQueue *queue = nullptr;
+    qreal growthFactor = 1.0;
+    AllocationHints allocationHints = AllocationHint::None;
+    // guards all state of the pool and its Buffers, recursive as Buffers report back while being handed out
+    mutable QRecursiveMutex mutex;
+    // bytes in freeRanges and the most bytes ever held by Buffers
+    qint64 freeBytes = 0;
+    qint64 highWaterMark = 0;
+    // when the last Buffer got requested
+    QElapsedTimer lastActivity;
+    bool trimmedSinceActivity = false;
+    int idleTrimTimeout = 0;
+    QTimer *idleTimer = nullptr;
+    // pressure stall information trigger, see Documentation/accounting/psi.rst of the kernel
+    int pressureFd = -1;
+    QSocketNotifier *pressureNotifier = nullptr;
+    // held for writing while the pool gets unmapped, held for reading while copying into a Buffer
+    mutable QReadWriteLock mappingLock;
+
+    static const int32_t s_initialSize = 1024;
+    // all ranges handed out by the pool are aligned to this amount of bytes
+    static const int32_t s_alignment = 64;
+    // Buffers which missed more frames than this get a full copy
+    static const int s_maxBufferAge = 8;
+
+private:
+    static void formatCallback(void *data, wl_shm *shm, uint32_t format);
+    static const struct wl_shm_listener s_listener;
+    ShmPool *q;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,201 @@
+/*
+    SPDX-FileCopyrightText: 2026 Lingmo OS Team
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+#include "shm_swapchain.h"
+#include "event_queue.h"
+#include "pixelconversion_p.h"
+#include "shm_pool.h"
+// Qt
+#include <QDeadlineTimer>
+#include <QPointer>
+
+namespace KWayland
+{
+namespace Client
+{
+class Q_DECL_HIDDEN ShmSwapchain::Private
+{
+public:
+    Private(ShmPool *pool, Surface *surface, int bufferCount);
+    void releaseBuffers();
+
+    struct Slot {
+        Buffer::Ptr buffer;
+        // attached to the surface and not yet released by the compositor
+        bool busy = false;
+        // the frame the Buffer got presented with, 0 if never presented
+        quint64 frame = 0;
+    };
+    QPointer<ShmPool> pool;
+    QPointer<Surface> surface;
+    int bufferCount;
+    QSize size;
+    Buffer::Format format = Buffer::Format::ARGB32;
+    QList<Slot> slots;
+    int current = -1;
+    quint64 frameCounter = 0;
+};
+
+ShmSwapchain::Private::Private(ShmPool *pool, Surface *surface, int bufferCount)
+    : pool(pool)
+    , surface(surface)
+    , bufferCount(qMax(1, bufferCount))
+{
+}
+
+void ShmSwapchain::Private::releaseBuffers()
+{
+    for (const Slot &slot : std::as_const(slots)) {
+        auto buffer = slot.buffer.toStrongRef();
+        if (!buffer) {
+            continue;
+        }
+        if (!slot.busy) {
+            // the compositor does not hold the Buffer, so the pool may reuse it directly
+            buffer->setReleased(true);
+        }
+        buffer->setUsed(false);
+    }
+    slots.clear();
+    current = -1;
+}
+
+ShmSwapchain::ShmSwapchain(ShmPool *pool, Surface *surface, int bufferCount, QObject *parent)
+    : QObject(parent)
+    , d(new Private(pool, surface, bufferCount))
+{
+}
+
+ShmSwapchain::~ShmSwapchain()
+{
+    d->releaseBuffers();
+}
+
+ShmPool *ShmSwapchain::pool() const
+{
+    return d->pool;
+}
+
+Surface *ShmSwapchain::surface() const
+{
+    return d->surface;
+}
+
+int ShmSwapchain::bufferCount() const
+{
+    return d->bufferCount;
+}
+
+QSize ShmSwapchain::size() const
+{
+    return d->size;
+}
+
+Buffer::Format ShmSwapchain::format() const
+{
+    return d->format;
+}
+
+bool ShmSwapchain::resize(const QSize &size, Buffer::Format format)
+{
+    d->releaseBuffers();
+    d->size = size;
+    d->format = format;
+    d->frameCounter = 0;
+    if (!d->pool || size.isEmpty()) {
+        return false;
+    }
+    const int32_t stride = bufferStride(size.width(), format);
+    for (int i = 0; i < d->bufferCount; ++i) {
+        auto buffer = d->pool->getBuffer(size, stride, format).toStrongRef();
+        if (!buffer) {
+            d->releaseBuffers();
+            return false;
+        }
+        buffer->setUsed(true);
+        d->slots.append(Private::Slot{buffer.toWeakRef()});
+    }
+    return true;
+}
+
+Buffer::Ptr ShmSwapchain::acquire(int timeout)
+{
+    d->current = -1;
+    const QDeadlineTimer deadline(timeout);
+    while (true) {
+        for (int i = 0; i < d->slots.size(); ++i) {
+            Private::Slot &slot = d->slots[i];
+            auto buffer = slot.buffer.toStrongRef();
+            if (!buffer) {
+                continue;
+            }
+            if (slot.busy && buffer->isReleased()) {
+                slot.busy = false;
+            }
+            if (!slot.busy && (d->current == -1 || slot.frame < d->slots.at(d->current).frame)) {
+                d->current = i;
+            }
+        }
+        if (d->current != -1) {
+            return d->slots.at(d->current).buffer;
+        }
+        EventQueue *queue = d->pool ? d->pool->eventQueue() : nullptr;
+        if (!queue || deadline.hasExpired()) {
+            return Buffer::Ptr();
+        }
+        if (!queue->waitForEvents(deadline.isForever() ? -1 : int(deadline.remainingTime()))) {
+            return Buffer::Ptr();
+        }
+    }
+}
+
+int ShmSwapchain::bufferAge() const
+{
+    if (d->current == -1) {
+        return 0;
+    }
+    const quint64 frame = d->slots.at(d->current).frame;
+    if (frame == 0) {
+        return 0;
+    }
+    return d->frameCounter + 1 - frame;
+}
+
+QImage ShmSwapchain::image() const
+{
+    if (d->current == -1) {
+        return QImage();
+    }
+    auto buffer = d->slots.at(d->current).buffer.toStrongRef();
+    if (!buffer) {
+        return QImage();
+    }
+    return QImage(buffer->address(), d->size.width(), d->size.height(), buffer->stride(), imageFormat(d->format));
+}
+
+void ShmSwapchain::present(const QRegion &damage, Surface::CommitFlag flag)
+{
+    if (d->current == -1 || !d->surface) {
+        return;
+    }
+    Private::Slot &slot = d->slots[d->current];
+    d->current = -1;
+    auto buffer = slot.buffer.toStrongRef();
+    if (!buffer) {
+        return;
+    }
+    // from now on the compositor holds the Buffer until it sends the release event
+    buffer->setReleased(false);
+    d->surface->attachBuffer(buffer.data());
+    d->surface->damageBuffer(damage);
+    d->surface->commit(flag);
+    slot.busy = true;
+    slot.frame = ++d->frameCounter;
+}
+
+}
+}
+
+#include "moc_shm_swapchain.cpp"
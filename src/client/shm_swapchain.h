@@ -0,0 +1,134 @@
+/*
+    SPDX-FileCopyrightText: 2026 Lingmo OS Team
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+#ifndef WAYLAND_SHM_SWAPCHAIN_H
+#define WAYLAND_SHM_SWAPCHAIN_H
+
+#include <QImage>
+#include <QObject>
+#include <QRegion>
+
+#include "KWayland/Client/kwaylandclient_export.h"
+#include "buffer.h"
+#include "surface.h"
+
+namespace KWayland
+{
+namespace Client
+{
+class ShmPool;
+
+/**
+ * @short A fixed set of Buffers rotated for presenting on a Surface.
+ *
+ * The ShmSwapchain allocates a fixed number of Buffers from a ShmPool and hands
+ * them out in turn for rendering into a Surface. This bounds the memory used for
+ * a Surface and avoids allocating Buffers per frame.
+ *
+ * Each frame starts with acquire(), which provides the released Buffer that was
+ * presented longest ago together with its bufferAge(). Once rendering is done,
+ * present() attaches the Buffer to the Surface, damages and commits it:
+ * @code
+ * ShmSwapchain *swapchain = new ShmSwapchain(pool, surface);
+ * swapchain->resize(QSize(200, 200));
+ *
+ * if (!swapchain->acquire()) {
+ *     // all Buffers are still used by the compositor, try again later
+ *     return;
+ * }
+ * QImage image = swapchain->image();
+ * // repaint what changed since the Buffer was presented, see bufferAge
+ * swapchain->present(damage);
+ * @endcode
+ *
+ * The Buffers of the ShmSwapchain are marked as used, so that the ShmPool does not
+ * hand them out elsewhere. On resize all Buffers are given back to the ShmPool and
+ * a new set gets allocated at once.
+ *
+ * @see ShmPool
+ * @since 6.2
+ **/
+class KWAYLANDCLIENT_EXPORT ShmSwapchain : public QObject
+{
+    Q_OBJECT
+public:
+    /**
+     * Creates a ShmSwapchain of @p bufferCount Buffers from @p pool for presenting on @p surface.
+     * No Buffer gets allocated before resize is called.
+     **/
+    explicit ShmSwapchain(ShmPool *pool, Surface *surface, int bufferCount = 3, QObject *parent = nullptr);
+    ~ShmSwapchain() override;
+
+    /**
+     * @returns The ShmPool the Buffers are allocated from.
+     **/
+    ShmPool *pool() const;
+    /**
+     * @returns The Surface the Buffers are presented on.
+     **/
+    Surface *surface() const;
+    /**
+     * @returns The number of Buffers in this ShmSwapchain.
+     **/
+    int bufferCount() const;
+    /**
+     * @returns The size of the Buffers.
+     **/
+    QSize size() const;
+    /**
+     * @returns The format of the Buffers.
+     **/
+    Buffer::Format format() const;
+
+    /**
+     * Gives all Buffers back to the ShmPool and allocates bufferCount new Buffers
+     * of @p size and @p format.
+     *
+     * @returns @c true if all Buffers could be allocated
+     **/
+    bool resize(const QSize &size, Buffer::Format format = Buffer::Format::ARGB32);
+
+    /**
+     * Provides the Buffer to render the next frame into.
+     *
+     * Of all Buffers which are released by the compositor, the one presented longest
+     * ago is returned. If no Buffer is released, the EventQueue of the ShmPool gets
+     * dispatched until one is released or @p timeout milliseconds passed. A negative
+     * @p timeout waits forever, the default is not to wait at all.
+     *
+     * @returns The Buffer to render into, a @c null Buffer::Ptr if all Buffers are in use
+     * @see bufferAge
+     * @see present
+     **/
+    Buffer::Ptr acquire(int timeout = 0);
+    /**
+     * The age of the Buffer provided by the last acquire.
+     *
+     * An age of @c 0 means that the content of the Buffer is undefined. Otherwise the
+     * Buffer holds the content presented @c n frames ago, e.g. @c 1 if it is the Buffer
+     * presented with the previous frame.
+     **/
+    int bufferAge() const;
+    /**
+     * @returns A QImage sharing the memory of the Buffer provided by the last acquire, a
+     * null QImage if there is no such Buffer.
+     * The QImage must not be used after present.
+     **/
+    QImage image() const;
+    /**
+     * Attaches the Buffer provided by the last acquire to the surface, damages @p damage
+     * in buffer coordinates and commits the surface with @p flag.
+     **/
+    void present(const QRegion &damage, Surface::CommitFlag flag = Surface::CommitFlag::FrameCallback);
+
+private:
+    class Private;
+    QScopedPointer<Private> d;
+};
+
+}
+}
+
+#endif
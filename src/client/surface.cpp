@@ -21,6 +21,7 @@ namespace Client
 {
 
 QList<Surface *> Surface::Private::s_surfaces = QList<Surface *>();
+QHash<wl_surface *, Surface *> Surface::Private::s_nativeSurfaces;
 
 Surface::Private::Private(Surface *q)
     : q(q)
@@ -43,11 +44,13 @@ Surface::~Surface()
 
 void Surface::release()
 {
+    d->removeFromIndex();
     d->surface.release();
 }
 
 void Surface::destroy()
 {
+    d->removeFromIndex();
     d->surface.destroy();
 }
 
@@ -61,9 +64,18 @@ void Surface::Private::setup(wl_surface *s)
     Q_ASSERT(s);
     Q_ASSERT(!surface);
     surface.setup(s);
+    s_nativeSurfaces.insert(s, q);
     wl_surface_add_listener(s, &s_surfaceListener, this);
 }
 
+void Surface::Private::removeFromIndex()
+{
+    auto it = s_nativeSurfaces.find(surface);
+    if (it != s_nativeSurfaces.end() && *it == q) {
+        s_nativeSurfaces.erase(it);
+    }
+}
+
 void Surface::Private::frameCallback(void *data, wl_callback *callback, uint32_t time)
 {
     Q_UNUSED(time)
@@ -211,13 +223,7 @@ void Surface::setSize(const QSize &size)
 
 Surface *Surface::get(wl_surface *native)
 {
-    auto it = std::find_if(Private::s_surfaces.constBegin(), Private::s_surfaces.constEnd(), [native](Surface *s) {
-        return s->d->surface == native;
-    });
-    if (it != Private::s_surfaces.constEnd()) {
-        return *(it);
-    }
-    return nullptr;
+    return Private::s_nativeSurfaces.value(native);
 }
 
 const QList<Surface *> &Surface::all()
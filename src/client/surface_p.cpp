@@ -36,6 +36,7 @@ Surface *Surface::fromWindow(QWindow *window)
     }
     Surface *surface = new Surface(window);
     surface->d->surface.setup(s, true);
+    Private::s_nativeSurfaces.insert(s, surface);
 
     auto waylandWindow = dynamic_cast<QtWaylandClient::QWaylandWindow *>(window->handle());
     if (waylandWindow) {
@@ -8,6 +8,8 @@
 
 #include "surface.h"
 #include "wayland_pointer_p.h"
+
+#include <QHash>
 // Wayland
 #include <wayland-client-protocol.h>
 
@@ -29,8 +31,14 @@ public:
     QList<Output *> outputs;
 
     void setup(wl_surface *s);
+    /**
+     * Removes the native surface from s_nativeSurfaces, unless it got reused by another Surface.
+     **/
+    void removeFromIndex();
 
     static QList<Surface *> s_surfaces;
+    // looked up on every enter event, so indexed by the native surface
+    static QHash<wl_surface *, Surface *> s_nativeSurfaces;
 
 private:
     void handleFrameCallback();
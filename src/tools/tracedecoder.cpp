@@ -0,0 +1,263 @@
+/*
+    SPDX-FileCopyrightText: 2026 Lingmo OS Team
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+#include "../client/protocoltrace_p.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QFile>
+#include <QHash>
+#include <QTextStream>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+
+namespace KWayland
+{
+namespace Tools
+{
+using namespace KWayland::Client::ProtocolTrace;
+
+/**
+ * Reads the Records of a protocol trace from the oldest to the newest one.
+ **/
+class TraceReader
+{
+public:
+    bool open(const QString &fileName, QTextStream &err)
+    {
+        m_file.setFileName(fileName);
+        if (!m_file.open(QIODevice::ReadOnly)) {
+            err << "Cannot open " << fileName << ": " << m_file.errorString() << Qt::endl;
+            return false;
+        }
+        if (m_file.size() < qint64(sizeof(FileHeader))) {
+            err << fileName << " is not a protocol trace" << Qt::endl;
+            return false;
+        }
+        const uchar *data = m_file.map(0, m_file.size());
+        if (!data) {
+            err << "Cannot map " << fileName << ": " << m_file.errorString() << Qt::endl;
+            return false;
+        }
+        memcpy(&m_header, data, sizeof(FileHeader));
+        if (memcmp(m_header.magic, s_magic, sizeof(s_magic)) != 0 || m_header.version != s_version) {
+            err << fileName << " is not a protocol trace of a supported version" << Qt::endl;
+            return false;
+        }
+        if (m_header.headerSize + m_header.capacity > quint64(m_file.size()) || m_header.used > m_header.capacity) {
+            err << fileName << " is truncated" << Qt::endl;
+            return false;
+        }
+        m_ring = reinterpret_cast<const char *>(data) + m_header.headerSize;
+        return true;
+    }
+
+    const FileHeader &header() const
+    {
+        return m_header;
+    }
+
+    void forEach(const std::function<void(const Record &, const char *payload)> &callback) const
+    {
+        forEachRecord(m_header, m_ring, callback);
+    }
+
+private:
+    QFile m_file;
+    FileHeader m_header;
+    const char *m_ring = nullptr;
+};
+
+/**
+ * Resolves object ids to interface names by following wl_display and wl_registry messages.
+ * Objects created by other interfaces are only known by their id.
+ **/
+class ObjectTracker
+{
+public:
+    ObjectTracker()
+    {
+        m_objects.insert(1, QByteArrayLiteral("wl_display"));
+    }
+
+    QByteArray name(uint32_t objectId) const
+    {
+        return m_objects.value(objectId, QByteArrayLiteral("?")) + '@' + QByteArray::number(objectId);
+    }
+
+    void track(const Record &record, const char *payload)
+    {
+        const uint32_t available = recordedPayload(record);
+        Arguments args{payload, available};
+        const QByteArray interface = m_objects.value(record.objectId);
+        if (interface == "wl_display") {
+            if (record.direction == Direction::Request && record.opcode == 0) {
+                m_objects.insert(args.uint(), QByteArrayLiteral("wl_callback"));
+            } else if (record.direction == Direction::Request && record.opcode == 1) {
+                m_objects.insert(args.uint(), QByteArrayLiteral("wl_registry"));
+            } else if (record.direction == Direction::Event && record.opcode == 1) {
+                m_objects.remove(args.uint());
+            }
+        } else if (interface == "wl_registry" && record.direction == Direction::Request && record.opcode == 0) {
+            args.uint();
+            const QByteArray boundInterface = args.string();
+            args.uint();
+            const uint32_t id = args.uint();
+            if (args.valid) {
+                m_objects.insert(id, boundInterface);
+            }
+        }
+    }
+
+private:
+    struct Arguments {
+        const char *data;
+        uint32_t size;
+        uint32_t offset = 0;
+        bool valid = true;
+
+        uint32_t uint()
+        {
+            if (offset + 4 > size) {
+                valid = false;
+                return 0;
+            }
+            uint32_t value;
+            memcpy(&value, data + offset, 4);
+            offset += 4;
+            return value;
+        }
+        QByteArray string()
+        {
+            const uint32_t length = uint();
+            if (!valid || length == 0 || offset + length > size) {
+                valid = false;
+                return QByteArray();
+            }
+            // the length includes the terminating null byte, the content is padded to 32 bit
+            const QByteArray value(data + offset, length - 1);
+            offset += (length + 3) & ~3u;
+            return value;
+        }
+    };
+    QHash<uint32_t, QByteArray> m_objects;
+};
+
+static QString formatTime(uint64_t nanoseconds)
+{
+    return QString::number(nanoseconds / 1000000.0, 'f', 3);
+}
+
+static void printRecords(const TraceReader &reader, QTextStream &out)
+{
+    ObjectTracker tracker;
+    reader.forEach([&](const Record &record, const char *payload) {
+        tracker.track(record, payload);
+        out << qSetFieldWidth(12) << formatTime(record.timestamp) << qSetFieldWidth(0) << " ms "
+            << (record.direction == Direction::Request ? "-> " : "<- ") << tracker.name(record.objectId) << '.' << record.opcode << " (" << record.size
+            << " bytes";
+        if (record.fdCount > 0) {
+            out << ", " << record.fdCount << " fds";
+        }
+        out << ")\n";
+    });
+}
+
+static void printSummary(const TraceReader &reader, uint64_t window, QTextStream &out)
+{
+    struct Count {
+        QByteArray message;
+        quint64 count = 0;
+        quint64 bytes = 0;
+    };
+    ObjectTracker tracker;
+    QHash<QByteArray, Count> counts;
+    // timestamps within the current window for finding the largest burst
+    QList<uint64_t> recent;
+    qsizetype recentStart = 0;
+    qsizetype burstSize = 0;
+    uint64_t burstStart = 0;
+    quint64 total = 0;
+    reader.forEach([&](const Record &record, const char *payload) {
+        tracker.track(record, payload);
+        QByteArray name = tracker.name(record.objectId);
+        // ids get reused, summarize by interface
+        name.truncate(name.lastIndexOf('@'));
+        const QByteArray message = (record.direction == Direction::Request ? "-> " : "<- ") + name + '.' + QByteArray::number(record.opcode);
+        Count &count = counts[message];
+        count.message = message;
+        ++count.count;
+        count.bytes += record.size + 8;
+        ++total;
+
+        recent.append(record.timestamp);
+        while (record.timestamp - recent.at(recentStart) > window) {
+            ++recentStart;
+        }
+        if (recent.size() - recentStart > burstSize) {
+            burstSize = recent.size() - recentStart;
+            burstStart = recent.at(recentStart);
+        }
+        if (recentStart > 4096) {
+            recent.remove(0, recentStart);
+            recentStart = 0;
+        }
+    });
+
+    QList<Count> sorted = counts.values();
+    std::sort(sorted.begin(), sorted.end(), [](const Count &a, const Count &b) {
+        return a.count > b.count;
+    });
+    out << "Messages: " << total << ", dropped: " << reader.header().droppedCount << '\n';
+    out << "Largest burst: " << burstSize << " messages within " << formatTime(window) << " ms at " << formatTime(burstStart) << " ms\n\n";
+    for (const Count &count : std::as_const(sorted)) {
+        out << qSetFieldWidth(10) << count.count << qSetFieldWidth(12) << count.bytes << qSetFieldWidth(0) << "  " << count.message << '\n';
+    }
+}
+
+}
+}
+
+int main(int argc, char **argv)
+{
+    using namespace KWayland::Tools;
+
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Decodes protocol traces recorded through KWayland::Client::ConnectionThread::setTraceFile."));
+    QCommandLineOption summary(QStringList{QStringLiteral("s"), QStringLiteral("summary")},
+                               QStringLiteral("Print the number of messages per interface and the largest burst instead of all messages."));
+    QCommandLineOption window(QStringList{QStringLiteral("w"), QStringLiteral("window")},
+                              QStringLiteral("The time window in milliseconds for finding the largest burst, defaults to 16."),
+                              QStringLiteral("ms"),
+                              QStringLiteral("16"));
+    parser.addHelpOption();
+    parser.addOption(summary);
+    parser.addOption(window);
+    parser.addPositionalArgument(QStringLiteral("trace"), QStringLiteral("The protocol trace to decode."));
+
+    parser.process(app);
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+    if (parser.positionalArguments().size() != 1) {
+        parser.showHelp(1);
+    }
+    TraceReader reader;
+    if (!reader.open(parser.positionalArguments().constFirst(), err)) {
+        return 1;
+    }
+    out << "Recording started at " << QDateTime::fromMSecsSinceEpoch(reader.header().startTime / 1000000).toString(Qt::ISODateWithMs) << '\n';
+    if (parser.isSet(summary)) {
+        printSummary(reader, parser.value(window).toULongLong() * 1000000, out);
+    } else {
+        printRecords(reader, out);
+    }
+    return 0;
+}
@@ -0,0 +1,497 @@
+/*
+    SPDX-FileCopyrightText: 2026 Lingmo OS Team
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+#include "../src/client/connection_thread.h"
+#include "../src/client/event_queue.h"
+#include "../src/client/lingmowindowmanagement.h"
+#include "../src/client/lingmowindowmodel.h"
+#include "../src/client/protocoltrace_p.h"
+#include "../src/client/registry.h"
+// Qt
+#include <QCommandLineParser>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFuture>
+#include <QGuiApplication>
+#include <QTextStream>
+#include <QThread>
+#include <QTimer>
+// system
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <functional>
+
+using namespace KWayland::Client;
+namespace Trace = KWayland::Client::ProtocolTrace;
+
+static qint64 cpuTime(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return qint64(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+struct TraceMessage {
+    Trace::Record record;
+    QByteArray payload;
+};
+
+/**
+ * Stands in for the Wayland server by replaying the events of a trace.
+ *
+ * The replay runs in lockstep with the client: before sending the events following a
+ * recorded request, the stand-in waits for the client to send a request. As object ids get
+ * allocated in order, the client stack has to issue the same requests as the one which got
+ * recorded, so traces should be recorded with this tool as well.
+ *
+ * Once the trace is replayed, the stand-in only answers wl_display.sync requests.
+ **/
+class ServerStandIn
+{
+public:
+    ServerStandIn(const QList<TraceMessage> &messages, int fd)
+        : m_messages(messages)
+        , m_fd(fd)
+    {
+    }
+    ~ServerStandIn()
+    {
+        close(m_fd);
+    }
+
+    void run(const std::function<void()> &replayed)
+    {
+        const qint64 cpuStart = cpuTime(CLOCK_THREAD_CPUTIME_ID);
+        for (const TraceMessage &message : std::as_const(m_messages)) {
+            if (message.record.direction == Trace::Direction::Request) {
+                if (!flush() || !nextRequest(message.record)) {
+                    break;
+                }
+                continue;
+            }
+            // file descriptors are missing or the arguments were not recorded completely
+            if (message.record.fdCount > 0) {
+                ++skippedEvents;
+                continue;
+            }
+            if (message.record.size > message.payload.size()) {
+                ++skippedEvents;
+                ++truncatedEvents;
+                continue;
+            }
+            appendEvent(message.record.objectId, message.record.opcode, message.payload);
+            ++replayedEvents;
+        }
+        flush();
+        cpu = cpuTime(CLOCK_THREAD_CPUTIME_ID) - cpuStart;
+        replayed();
+        answerSyncs();
+    }
+
+    int replayedEvents = 0;
+    int skippedEvents = 0;
+    // skipped as the trace got recorded with a smaller payload limit
+    int truncatedEvents = 0;
+    // requests of the client not matching the trace
+    int divergences = 0;
+    qint64 cpu = 0;
+
+private:
+    struct Request {
+        uint32_t objectId;
+        uint16_t opcode;
+        QByteArray arguments;
+    };
+
+    void appendEvent(uint32_t objectId, uint16_t opcode, const QByteArray &arguments)
+    {
+        const uint32_t words[2] = {objectId, uint32_t(arguments.size() + 8) << 16 | opcode};
+        m_out.append(reinterpret_cast<const char *>(words), sizeof(words));
+        m_out.append(arguments);
+    }
+
+    bool flush()
+    {
+        qsizetype offset = 0;
+        while (offset < m_out.size()) {
+            const ssize_t sent = send(m_fd, m_out.constData() + offset, m_out.size() - offset, MSG_NOSIGNAL);
+            if (sent == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                m_disconnected = true;
+                return false;
+            }
+            offset += sent;
+        }
+        m_out.clear();
+        return true;
+    }
+
+    bool nextRequest(const Trace::Record &expected)
+    {
+        while (m_requests.isEmpty()) {
+            if (!readRequests(s_timeout)) {
+                if (m_disconnected) {
+                    return false;
+                }
+                qWarning() << "Client did not send a request within" << s_timeout << "ms, continuing";
+                ++divergences;
+                return true;
+            }
+        }
+        const Request request = m_requests.takeFirst();
+        if (request.objectId != expected.objectId || request.opcode != expected.opcode) {
+            ++divergences;
+        }
+        return true;
+    }
+
+    bool readRequests(int timeout)
+    {
+        struct pollfd pfd = {m_fd, POLLIN, 0};
+        const int ready = poll(&pfd, 1, timeout);
+        if (ready <= 0) {
+            return false;
+        }
+        char buffer[4096];
+        char control[CMSG_SPACE(sizeof(int) * 28)];
+        struct iovec iov = {buffer, sizeof(buffer)};
+        struct msghdr msg = {};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        const ssize_t received = recvmsg(m_fd, &msg, MSG_CMSG_CLOEXEC);
+        if (received <= 0) {
+            m_disconnected = received == 0 || errno != EINTR;
+            return false;
+        }
+        // file descriptors passed with requests are not needed
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+                const int count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                for (int i = 0; i < count; ++i) {
+                    int fd;
+                    memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+                    close(fd);
+                }
+            }
+        }
+        m_in.append(buffer, received);
+        qsizetype offset = 0;
+        while (m_in.size() - offset >= 8) {
+            uint32_t words[2];
+            memcpy(words, m_in.constData() + offset, sizeof(words));
+            const uint32_t size = words[1] >> 16;
+            if (size < 8) {
+                m_disconnected = true;
+                return false;
+            }
+            if (m_in.size() - offset < size) {
+                break;
+            }
+            m_requests.append(Request{words[0], uint16_t(words[1] & 0xffff), m_in.mid(offset + 8, size - 8)});
+            offset += size;
+        }
+        m_in.remove(0, offset);
+        return true;
+    }
+
+    void answerSyncs()
+    {
+        while (!m_disconnected) {
+            while (m_requests.isEmpty()) {
+                if (!readRequests(-1) && m_disconnected) {
+                    return;
+                }
+            }
+            const Request request = m_requests.takeFirst();
+            if (request.objectId != 1 || request.opcode != 0 || request.arguments.size() < 4) {
+                continue;
+            }
+            uint32_t callback;
+            memcpy(&callback, request.arguments.constData(), sizeof(callback));
+            // wl_callback.done and wl_display.delete_id
+            appendEvent(callback, 0, QByteArray(4, '\0'));
+            appendEvent(1, 1, QByteArray(reinterpret_cast<const char *>(&callback), sizeof(callback)));
+            flush();
+        }
+    }
+
+    static const int s_timeout = 5000;
+    QList<TraceMessage> m_messages;
+    int m_fd;
+    bool m_disconnected = false;
+    QByteArray m_in;
+    QByteArray m_out;
+    QList<Request> m_requests;
+};
+
+/**
+ * The client stack under test: a Registry binding LingmoWindowManagement with a LingmoWindowModel,
+ * dispatched on an EventQueue in the main thread.
+ **/
+class WindowManagementClient : public QObject
+{
+    Q_OBJECT
+public:
+    explicit WindowManagementClient(QObject *parent = nullptr)
+        : QObject(parent)
+        , m_connectionThread(new QThread(this))
+        , m_connectionThreadObject(new ConnectionThread())
+    {
+    }
+    ~WindowManagementClient() override
+    {
+        delete m_model;
+        delete m_windowManagement;
+        delete m_registry;
+        delete m_eventQueue;
+        connect(m_connectionThread, &QThread::finished, m_connectionThreadObject, &QObject::deleteLater);
+        m_connectionThread->quit();
+        m_connectionThread->wait();
+    }
+
+    void init(int fd, const QString &traceFile)
+    {
+        if (fd != -1) {
+            m_connectionThreadObject->setSocketFd(fd);
+        }
+        if (!traceFile.isEmpty()) {
+            m_connectionThreadObject->setTraceFile(traceFile);
+        }
+        connect(
+            m_connectionThreadObject,
+            &ConnectionThread::connected,
+            this,
+            [this] {
+                m_eventQueue = new EventQueue(this);
+                m_eventQueue->setup(m_connectionThreadObject);
+
+                m_registry = new Registry(this);
+                connect(m_registry, &Registry::lingmoWindowManagementAnnounced, this, [this](quint32 name, quint32 version) {
+                    m_windowManagement = m_registry->createLingmoWindowManagement(name, version, this);
+                    m_model = m_windowManagement->createWindowModel();
+                });
+                m_registry->create(m_connectionThreadObject);
+                m_registry->setEventQueue(m_eventQueue);
+                m_registry->setup();
+            },
+            Qt::QueuedConnection);
+        connect(m_connectionThreadObject, &ConnectionThread::failed, qApp, [] {
+            qWarning() << "Failed to connect";
+            QCoreApplication::exit(1);
+        });
+        m_connectionThreadObject->moveToThread(m_connectionThread);
+        m_connectionThread->start();
+
+        m_connectionThreadObject->initConnection();
+    }
+
+    EventQueue *eventQueue() const
+    {
+        return m_eventQueue;
+    }
+
+    LingmoWindowModel *model() const
+    {
+        return m_model;
+    }
+
+private:
+    QThread *m_connectionThread;
+    ConnectionThread *m_connectionThreadObject;
+    EventQueue *m_eventQueue = nullptr;
+    Registry *m_registry = nullptr;
+    LingmoWindowManagement *m_windowManagement = nullptr;
+    LingmoWindowModel *m_model = nullptr;
+};
+
+/**
+ * Replays a trace once against a new WindowManagementClient and measures how long it takes.
+ **/
+class Replay : public QObject
+{
+    Q_OBJECT
+public:
+    explicit Replay(const QList<TraceMessage> &messages, QObject *parent = nullptr)
+        : QObject(parent)
+        , m_messages(messages)
+    {
+    }
+    ~Replay() override
+    {
+        delete m_client;
+        if (m_thread) {
+            m_thread->wait();
+            delete m_thread;
+        }
+        delete m_standIn;
+    }
+
+    void start()
+    {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == -1) {
+            qWarning() << "Could not create socket pair:" << strerror(errno);
+            QCoreApplication::exit(1);
+            return;
+        }
+        m_standIn = new ServerStandIn(m_messages, fds[0]);
+        m_thread = QThread::create([this] {
+            m_standIn->run([this] {
+                QMetaObject::invokeMethod(this, &Replay::replayed, Qt::QueuedConnection);
+            });
+        });
+        m_client = new WindowManagementClient(this);
+
+        m_timer.start();
+        m_dispatchCpuStart = cpuTime(CLOCK_THREAD_CPUTIME_ID);
+        m_processCpuStart = cpuTime(CLOCK_PROCESS_CPUTIME_ID);
+        m_thread->start();
+        m_client->init(fds[1], QString());
+    }
+
+    // all numbers in nanoseconds
+    qint64 wallTime = 0;
+    qint64 dispatchCpu = 0;
+    qint64 clientCpu = 0;
+    int windows = 0;
+
+    ServerStandIn *standIn() const
+    {
+        return m_standIn;
+    }
+
+Q_SIGNALS:
+    void finished();
+
+private:
+    void replayed()
+    {
+        if (!m_client->eventQueue()) {
+            qWarning() << "The trace did not get the client connected";
+            QCoreApplication::exit(1);
+            return;
+        }
+        // everything sent by the stand-in got dispatched once the roundtrip finished
+        m_client->eventQueue()->asyncRoundtrip().then(this, [this] {
+            wallTime = m_timer.nsecsElapsed();
+            dispatchCpu = cpuTime(CLOCK_THREAD_CPUTIME_ID) - m_dispatchCpuStart;
+            clientCpu = cpuTime(CLOCK_PROCESS_CPUTIME_ID) - m_processCpuStart - m_standIn->cpu;
+            windows = m_client->model() ? m_client->model()->rowCount() : 0;
+            Q_EMIT finished();
+        });
+    }
+
+    QList<TraceMessage> m_messages;
+    ServerStandIn *m_standIn = nullptr;
+    QThread *m_thread = nullptr;
+    WindowManagementClient *m_client = nullptr;
+    QElapsedTimer m_timer;
+    qint64 m_dispatchCpuStart = 0;
+    qint64 m_processCpuStart = 0;
+};
+
+static bool loadTrace(const QString &fileName, QList<TraceMessage> &messages)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Cannot open" << fileName << file.errorString();
+        return false;
+    }
+    const QByteArray data = file.readAll();
+    Trace::FileHeader header;
+    if (data.size() < qsizetype(sizeof(header))) {
+        qWarning() << fileName << "is not a protocol trace";
+        return false;
+    }
+    memcpy(&header, data.constData(), sizeof(header));
+    if (memcmp(header.magic, Trace::s_magic, sizeof(Trace::s_magic)) != 0 || header.version != Trace::s_version
+        || header.headerSize + header.capacity > quint64(data.size()) || header.used > header.capacity) {
+        qWarning() << fileName << "is not a protocol trace of a supported version";
+        return false;
+    }
+    if (header.droppedCount > 0) {
+        qWarning() << fileName << "does not start with the connection, record it with a larger capacity";
+        return false;
+    }
+    Trace::forEachRecord(header, data.constData() + header.headerSize, [&messages](const Trace::Record &record, const char *payload) {
+        messages.append(TraceMessage{record, QByteArray(payload, Trace::recordedPayload(record))});
+    });
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    // no compositor is needed for replaying
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", QByteArrayLiteral("offscreen"));
+    }
+    QGuiApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Replays a protocol trace against Registry, LingmoWindowManagement and LingmoWindowModel."));
+    QCommandLineOption record(QStringLiteral("record"),
+                              QStringLiteral("Record the trace from the running compositor instead of replaying it."));
+    QCommandLineOption duration(QStringLiteral("duration"), QStringLiteral("Seconds to record, defaults to 10."), QStringLiteral("seconds"), QStringLiteral("10"));
+    QCommandLineOption iterations(QStringLiteral("iterations"), QStringLiteral("Number of replays, defaults to 5."), QStringLiteral("count"), QStringLiteral("5"));
+    parser.addHelpOption();
+    parser.addOption(record);
+    parser.addOption(duration);
+    parser.addOption(iterations);
+    parser.addPositionalArgument(QStringLiteral("trace"), QStringLiteral("The protocol trace."));
+    parser.process(app);
+    if (parser.positionalArguments().size() != 1) {
+        parser.showHelp(1);
+    }
+    const QString traceFile = parser.positionalArguments().constFirst();
+
+    if (parser.isSet(record)) {
+        WindowManagementClient client;
+        client.init(-1, traceFile);
+        QTimer::singleShot(parser.value(duration).toInt() * 1000, &app, &QCoreApplication::quit);
+        return app.exec();
+    }
+
+    QList<TraceMessage> messages;
+    if (!loadTrace(traceFile, messages)) {
+        return 1;
+    }
+
+    QTextStream out(stdout);
+    const int count = qMax(1, parser.value(iterations).toInt());
+    int iteration = 0;
+    std::function<void()> next = [&] {
+        Replay *replay = new Replay(messages, &app);
+        QObject::connect(replay, &Replay::finished, &app, [&, replay] {
+            const int events = replay->standIn()->replayedEvents;
+            out << "Iteration " << ++iteration << ": " << events << " events in " << replay->wallTime / 1000000.0 << " ms, "
+                << qRound64(events / (replay->wallTime / 1000000000.0)) << " events/s, " << replay->dispatchCpu / 1000.0 / qMax(1, events)
+                << " µs dispatch CPU per event, " << replay->clientCpu / 1000.0 / qMax(1, events) << " µs client CPU per event, " << replay->windows
+                << " windows, " << replay->standIn()->skippedEvents << " skipped events (" << replay->standIn()->truncatedEvents << " truncated), " << replay->standIn()->divergences << " divergences"
+                << Qt::endl;
+            replay->deleteLater();
+            if (iteration < count) {
+                QMetaObject::invokeMethod(&app, next, Qt::QueuedConnection);
+            } else {
+                QCoreApplication::quit();
+            }
+        });
+        replay->start();
+    };
+    next();
+
+    return app.exec();
+}
+
+#include "windowmanagementreplay.moc"